@@ -0,0 +1,454 @@
+// Model build benchmark.
+//
+//   gcc bench_build.c -o bench_build
+//   ./bench_build [--scales 1,10,100] [--compare <baseline.json>] [--threshold <percent>]
+//                 <dictionary_directory> <input_directory>
+//
+// Runs the startup build (the steps of main and buildModel) on the input texts
+// repeated 1x, 10x, 100x ... and prints, per scale and phase, wall time, CPU
+// time, peak RSS and the number of allocations as a JSON array. Each scale is
+// built in a fresh child process under a temporary directory, so memory left
+// over from one scale does not show in the next.
+//
+// With --compare, the records are also checked against an earlier output of
+// this program: a phase that got slower, bigger or allocates more by more
+// than the threshold (default 10%) is reported on stderr and the exit status
+// is 2. Differences under 5 ms or 1 MB are taken for noise.
+
+#define _GNU_SOURCE         // nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <locale.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Every allocation made by the build code is counted. The system headers are
+// all included above, so the macros below only rename the calls in the
+// included sources.
+static long benchAllocations;
+
+static void *benchMalloc(size_t size) {
+    __atomic_add_fetch(&benchAllocations, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+static void *benchCalloc(size_t count, size_t size) {
+    __atomic_add_fetch(&benchAllocations, 1, __ATOMIC_RELAXED);
+    return calloc(count, size);
+}
+
+static void *benchRealloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&benchAllocations, 1, __ATOMIC_RELAXED);
+    return realloc(ptr, size);
+}
+
+static char *benchStrdup(const char *s) {
+    __atomic_add_fetch(&benchAllocations, 1, __ATOMIC_RELAXED);
+    return strdup(s);
+}
+
+static wchar_t *benchWcsdup(const wchar_t *s) {
+    __atomic_add_fetch(&benchAllocations, 1, __ATOMIC_RELAXED);
+    return wcsdup(s);
+}
+
+#define malloc(size) benchMalloc(size)
+#define calloc(count, size) benchCalloc(count, size)
+#define realloc(ptr, size) benchRealloc(ptr, size)
+#define strdup(s) benchStrdup(s)
+#define wcsdup(s) benchWcsdup(s)
+
+#define NGRAMS_NO_MAIN
+#include "runmain.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef wcsdup
+
+#define BENCH_MAX_SCALES 16
+#define BENCH_MAX_RECORDS 1024
+#define BENCH_PHASE_LEN 32
+#define BENCH_DEFAULT_THRESHOLD 10.0
+#define BENCH_MIN_MS 5.0            // smaller time differences are noise
+#define BENCH_MIN_RSS_KB 1024       // and so are smaller memory differences
+
+typedef struct BenchRecord {
+    int scale;
+    char phase[BENCH_PHASE_LEN];
+    double wallMs, cpuMs;
+    long peakRssKb;
+    long allocations;
+} BenchRecord;
+
+typedef struct BenchPhase {
+    struct timespec wall, cpu;
+    long allocations;
+} BenchPhase;
+
+static double elapsedMs(struct timespec *start, clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Peak RSS since the last reset, from VmHWM. Writing 5 to clear_refs resets
+// the mark; where that is not allowed the peak is the peak of the process.
+static long peakRssKb(void) {
+    FILE *status = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = 0;
+    if (!status) return 0;
+    while (fgets(line, sizeof(line), status))
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1) break;
+    fclose(status);
+    return kb;
+}
+
+static void resetPeakRss(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return;
+    if (write(fd, "5", 1) != 1) { /* the peak stays process-wide */ }
+    close(fd);
+}
+
+static void phaseStart(BenchPhase *phase) {
+    resetPeakRss();
+    phase->allocations = __atomic_load_n(&benchAllocations, __ATOMIC_RELAXED);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &phase->cpu);
+    clock_gettime(CLOCK_MONOTONIC, &phase->wall);
+}
+
+static void phaseEnd(BenchPhase *phase, int scale, const char *name, int out) {
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    record.wallMs = elapsedMs(&phase->wall, CLOCK_MONOTONIC);
+    record.cpuMs = elapsedMs(&phase->cpu, CLOCK_PROCESS_CPUTIME_ID);
+    record.peakRssKb = peakRssKb();
+    record.allocations = __atomic_load_n(&benchAllocations, __ATOMIC_RELAXED) - phase->allocations;
+    record.scale = scale;
+    snprintf(record.phase, sizeof(record.phase), "%s", name);
+    if (write(out, &record, sizeof(record)) != sizeof(record))
+        fprintf(stderr, "Cannot report phase %s\n", name);
+}
+
+// Writes corpus/inputfileN_M.txt: every input file repeated scale times. The
+// copies are spread over as many files as needed to stay under the MAX_WORDS
+// words per file that generateNgrams reads.
+static int writeScaledCorpus(char **inputs, int inputCount, int scale) {
+    if (mkdir("corpus", 0755) != 0) {
+        perror("mkdir corpus");
+        return -1;
+    }
+    int files = 0;
+    for (int i = 0; i < inputCount; i++) {
+        FILE *in = fopen(inputs[i], "r");
+        if (!in) {
+            perror(inputs[i]);
+            return -1;
+        }
+        char *text = NULL;
+        size_t len = 0, cap = 0, n;
+        char chunk[65536];
+        while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+            if (len + n + 1 > cap) {
+                cap = (len + n + 1) * 2;
+                text = realloc(text, cap);
+            }
+            memcpy(text + len, chunk, n);
+            len += n;
+        }
+        fclose(in);
+
+        long words = 0;
+        for (size_t j = 0; j < len; j++)
+            if ((j == 0 || strchr(" \t\r\n", text[j - 1])) && !strchr(" \t\r\n", text[j])) words++;
+        int perFile = words > 0 ? (int)((MAX_WORDS - 1) / words) : scale;
+        if (perFile < 1) perFile = 1;
+
+        for (int copy = 0; copy < scale; copy += perFile) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "corpus/inputfile%d_%d.txt", i + 1, copy / perFile + 1);
+            FILE *out = fopen(path, "w");
+            if (!out) {
+                perror(path);
+                free(text);
+                return -1;
+            }
+            for (int k = copy; k < scale && k < copy + perFile; k++) {
+                fwrite(text, 1, len, out);
+                fputc('\n', out);
+            }
+            fclose(out);
+            files++;
+        }
+        free(text);
+    }
+    if (files > MAX_FILES) {
+        fprintf(stderr, "Scale %d needs %d input files, more than %d\n", scale, files, MAX_FILES);
+        return -1;
+    }
+    return 0;
+}
+
+// One scale, in the child process, in its own directory: the dictionary and
+// unigram trie, then one model built the way buildModel does it. Records are
+// written to out.
+static int runScale(const char *dictDir, char **inputs, int inputCount, int scale, int out) {
+    if (writeScaledCorpus(inputs, inputCount, scale) != 0) return 1;
+
+    BenchPhase phase;
+    char *dictFiles[MAX_FILES], *inputFiles[MAX_FILES];
+    char path[256], shardPath[256], name[64];
+    const char *prefix = "bench_";
+
+    phaseStart(&phase);
+    int dictCount = collect_files(dictDir, dictFiles, NULL);
+    int inputFileCount = collect_files("corpus", inputFiles, "input");
+    phaseEnd(&phase, scale, "collect_files", out);
+    if (dictCount < 0 || inputFileCount < 0) return 1;
+
+    phaseStart(&phase);
+    TrieNode *root = buildUnifiedTrie(inputFileCount, inputFiles, dictCount, dictFiles);
+    phaseEnd(&phase, scale, "buildUnifiedTrie", out);
+
+    phaseStart(&phase);
+    generateNgrams(inputFileCount, inputFiles, prefix);
+    phaseEnd(&phase, scale, "generateNgrams", out);
+
+    phaseStart(&phase);
+    grams(prefix);
+    phaseEnd(&phase, scale, "grams", out);
+
+    NgramTable *tables[4];
+    for (int n = 2; n <= 5; n++) {
+        snprintf(path, sizeof(path), "%s%dgrms.txt", prefix, n);
+        phaseStart(&phase);
+        if (n >= SHARDED_NGRAM_ORDER) {
+            snprintf(shardPath, sizeof(shardPath), "%s%dgrms.shards", prefix, n);
+            writeShardedTable(path, shardPath);
+            tables[n - 2] = openShardedTable(shardPath, &ngramShardCache);
+            snprintf(name, sizeof(name), "writeShardedTable/%d", n);
+        } else {
+            tables[n - 2] = createMemoryTable(buildNgramTrie(path));
+            snprintf(name, sizeof(name), "buildNgramTrie/%d", n);
+        }
+        phaseEnd(&phase, scale, name, out);
+    }
+
+    freeDictTrie(root);
+    for (int n = 2; n <= 5; n++) freeNgramTable(tables[n - 2]);
+    for (int i = 0; i < dictCount; i++) free(dictFiles[i]);
+    for (int i = 0; i < inputFileCount; i++) free(inputFiles[i]);
+    return 0;
+}
+
+// Builds one scale in a child process and appends its records.
+static int benchScale(const char *workDir, const char *dictDir, char **inputs, int inputCount,
+                      int scale, BenchRecord *records, int *recordCount) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/scale-%d", workDir, scale);
+    if (mkdir(dir, 0755) != 0) {
+        perror(dir);
+        return -1;
+    }
+
+    int pipefd[2];
+    if (pipe(pipefd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        close(pipefd[0]);
+        // The build code reports progress on stdout, which carries the JSON.
+        if (!freopen("/dev/null", "w", stdout) || chdir(dir) != 0) _exit(1);
+        _exit(runScale(dictDir, inputs, inputCount, scale, pipefd[1]));
+    }
+
+    close(pipefd[1]);
+    BenchRecord record;
+    while (read(pipefd[0], &record, sizeof(record)) == sizeof(record)) {
+        if (*recordCount < BENCH_MAX_RECORDS) records[(*recordCount)++] = record;
+    }
+    close(pipefd[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Build at scale %d failed\n", scale);
+        return -1;
+    }
+    return 0;
+}
+
+static void writeRecords(FILE *out, BenchRecord *records, int count) {
+    fprintf(out, "[\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "  {\"scale\": %d, \"phase\": \"%s\", \"wallMs\": %.3f, \"cpuMs\": %.3f, "
+                     "\"peakRssKb\": %ld, \"allocations\": %ld}%s\n",
+                records[i].scale, records[i].phase, records[i].wallMs, records[i].cpuMs,
+                records[i].peakRssKb, records[i].allocations, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+// Reads records back from the output of writeRecords. Returns the count or -1.
+static int readRecords(const char *path, BenchRecord *records, int max) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return -1;
+    }
+    char line[512];
+    int count = 0;
+    while (fgets(line, sizeof(line), in) && count < max) {
+        char *object = strchr(line, '{');
+        BenchRecord *r = &records[count];
+        memset(r, 0, sizeof(*r));
+        if (object && sscanf(object, "{\"scale\": %d, \"phase\": \"%31[^\"]\", \"wallMs\": %lf, \"cpuMs\": %lf, "
+                                     "\"peakRssKb\": %ld, \"allocations\": %ld}",
+                             &r->scale, r->phase, &r->wallMs, &r->cpuMs, &r->peakRssKb, &r->allocations) == 6)
+            count++;
+    }
+    fclose(in);
+    return count;
+}
+
+static int regressed(double baseline, double current, double threshold, double floor) {
+    return current - baseline > floor && current > baseline * (1.0 + threshold / 100.0);
+}
+
+static void reportRegression(BenchRecord *r, const char *what, double baseline, double current) {
+    fprintf(stderr, "REGRESSION scale %d %s %s: %.1f -> %.1f (%+.1f%%)\n", r->scale, r->phase, what,
+            baseline, current, baseline > 0 ? (current - baseline) * 100.0 / baseline : 100.0);
+}
+
+// Number of regressions of current against baseline.
+static int compareRecords(BenchRecord *baseline, int baselineCount, BenchRecord *current, int count,
+                          double threshold) {
+    int regressions = 0;
+    for (int i = 0; i < count; i++) {
+        BenchRecord *r = &current[i], *b = NULL;
+        for (int j = 0; j < baselineCount && !b; j++)
+            if (baseline[j].scale == r->scale && strcmp(baseline[j].phase, r->phase) == 0) b = &baseline[j];
+        if (!b) continue;
+
+        if (regressed(b->wallMs, r->wallMs, threshold, BENCH_MIN_MS)) {
+            reportRegression(r, "wallMs", b->wallMs, r->wallMs);
+            regressions++;
+        }
+        if (regressed(b->cpuMs, r->cpuMs, threshold, BENCH_MIN_MS)) {
+            reportRegression(r, "cpuMs", b->cpuMs, r->cpuMs);
+            regressions++;
+        }
+        if (regressed(b->peakRssKb, r->peakRssKb, threshold, BENCH_MIN_RSS_KB)) {
+            reportRegression(r, "peakRssKb", b->peakRssKb, r->peakRssKb);
+            regressions++;
+        }
+        if (regressed(b->allocations, r->allocations, threshold, 0)) {
+            reportRegression(r, "allocations", b->allocations, r->allocations);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)flag; (void)ftw;
+    remove(path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    int scales[BENCH_MAX_SCALES] = { 1, 10, 100 }, scaleCount = 3;
+    const char *comparePath = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int argi = 1, badOption = 0;
+
+    while (argi < argc && strncmp(argv[argi], "--", 2) == 0 && !badOption) {
+        if (argi + 1 >= argc) {
+            badOption = 1;
+        } else if (strcmp(argv[argi], "--scales") == 0) {
+            scaleCount = 0;
+            char *state = NULL;
+            for (char *s = strtok_r(argv[argi + 1], ",", &state); s && scaleCount < BENCH_MAX_SCALES;
+                 s = strtok_r(NULL, ",", &state))
+                if ((scales[scaleCount] = atoi(s)) > 0) scaleCount++;
+            badOption = scaleCount == 0;
+        } else if (strcmp(argv[argi], "--compare") == 0) {
+            comparePath = argv[argi + 1];
+        } else if (strcmp(argv[argi], "--threshold") == 0) {
+            threshold = atof(argv[argi + 1]);
+        } else {
+            badOption = 1;
+        }
+        argi += 2;
+    }
+    if (badOption || argc - argi != 2) {
+        fprintf(stderr, "Usage: %s [--scales <n>,<n>,...] [--compare <baseline.json>] [--threshold <percent>]"
+                        " <dictionary_directory> <input_directory>\n", argv[0]);
+        return 1;
+    }
+
+    // Absolute paths: each scale is built in its own working directory.
+    char dictDir[PATH_MAX], inputDir[PATH_MAX];
+    if (!realpath(argv[argi], dictDir) || !realpath(argv[argi + 1], inputDir)) {
+        perror("realpath");
+        return 1;
+    }
+    char *inputs[MAX_FILES];
+    int inputCount = collect_files(inputDir, inputs, "input");
+    if (inputCount <= 0) {
+        fprintf(stderr, "No input files in %s\n", inputDir);
+        return 1;
+    }
+
+    static BenchRecord baseline[BENCH_MAX_RECORDS], records[BENCH_MAX_RECORDS];
+    int baselineCount = 0, recordCount = 0;
+    if (comparePath && (baselineCount = readRecords(comparePath, baseline, BENCH_MAX_RECORDS)) < 0)
+        return 1;
+
+    char workDir[] = "/tmp/bench_build.XXXXXX";
+    if (!mkdtemp(workDir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    int failed = 0;
+    for (int i = 0; i < scaleCount && !failed; i++)
+        failed = benchScale(workDir, dictDir, inputs, inputCount, scales[i], records, &recordCount) != 0;
+    nftw(workDir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    for (int i = 0; i < inputCount; i++) free(inputs[i]);
+    if (failed) return 1;
+
+    writeRecords(stdout, records, recordCount);
+    if (comparePath && compareRecords(baseline, baselineCount, records, recordCount, threshold) > 0)
+        return 2;
+    return 0;
+}
@@ -0,0 +1,214 @@
+// Trie lookup benchmark.
+//
+//   gcc -O2 bench_lookup.c -o bench_lookup
+//   ./bench_lookup [--lookups <n>] [--batch <n>] <dictionary_directory> <input_directory>
+//
+// Builds the dictionary trie and a bigram trie from the input texts, then
+// runs the same shuffled keys through searchPrefix, searchDict and
+// traverseContext one at a time and through their batch versions
+// (lookup_batch_hi.c), --batch keys per call (default 256), and prints the
+// time per lookup of both as a JSON array. A batch result that differs from
+// the single lookup is an error (exit status 1).
+//
+// Batching pays off when the trie does not fit in the cache: the dictionary
+// trie takes about 180 MB. A small trie that stays in cache is walked faster
+// one key at a time.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <time.h>
+
+#define NGRAMS_NO_MAIN
+#include "runmain.c"
+
+#define BENCH_DEFAULT_LOOKUPS 1000000
+#define BENCH_DEFAULT_BATCH 256      // keys handed to one batch call
+
+typedef struct BenchKeys {
+    wchar_t **keys;
+    int count, capacity;
+} BenchKeys;
+
+static void addKey(BenchKeys *keys, const wchar_t *key) {
+    if (keys->count == keys->capacity) {
+        keys->capacity = keys->capacity ? keys->capacity * 2 : 4096;
+        keys->keys = realloc(keys->keys, keys->capacity * sizeof(wchar_t *));
+        if (!keys->keys) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    keys->keys[keys->count++] = wcsdup(key);
+}
+
+// Every word of the dictionary trie, and for every tenth one a near miss
+// with its last letter changed.
+static void collectWords(TrieNode *node, wchar_t *buffer, int depth, BenchKeys *keys) {
+    if (depth >= MAX_WORD_LENGTH - 1) return;
+    if (depth > 0 && (node->isWord || node->frequency > 0)) {
+        buffer[depth] = L'\0';
+        addKey(keys, buffer);
+        if (keys->count % 10 == 0) {
+            wchar_t last = buffer[depth - 1];
+            buffer[depth - 1] = last == L'क' ? L'ख' : L'क';
+            addKey(keys, buffer);
+            buffer[depth - 1] = last;
+        }
+    }
+    for (int i = 0; i < MAX_CHILDREN; i++) {
+        if (node->children[i]) {
+            buffer[depth] = getCharFromIndex(i);
+            collectWords(node->children[i], buffer, depth + 1, keys);
+        }
+    }
+}
+
+// The bigrams of the input texts, inserted into a trie, and every
+// "<word> " context among them as a key.
+static ngramTrieNode *buildBigrams(char **inputs, int inputCount, BenchKeys *contexts) {
+    ngramTrieNode *root = createNgramNode();
+    wchar_t (*words)[MAX_WORDLEN] = malloc(sizeof(wchar_t[MAX_WORDS][MAX_WORDLEN]));
+    wchar_t line[2 * MAX_WORDLEN + 1];
+    for (int f = 0; f < inputCount && words; f++) {
+        FILE *in = fopen(inputs[f], "r");
+        if (!in) continue;
+        int count = tokenizeCorpusFile(in, words);
+        fclose(in);
+        for (int i = 0; i + 1 < count; i++) {
+            swprintf(line, sizeof(line) / sizeof(wchar_t), L"%ls %ls", words[i], words[i + 1]);
+            insertNgram(root, line);
+            swprintf(line, sizeof(line) / sizeof(wchar_t), L"%ls ", words[i]);
+            addKey(contexts, line);
+        }
+    }
+    free(words);
+    buildContinuationLists(root);
+    return root;
+}
+
+// lookups keys drawn at random from keys, so that successive lookups touch
+// unrelated parts of the trie.
+static const wchar_t **drawKeys(BenchKeys *keys, int lookups) {
+    const wchar_t **drawn = malloc(lookups * sizeof(wchar_t *));
+    unsigned long state = 88172645463325252ul;
+    for (int i = 0; i < lookups; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        drawn[i] = keys->keys[state % keys->count];
+    }
+    return drawn;
+}
+
+static double nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void writeResult(FILE *out, const char *lookup, int lookups, double singleNs, double batchNs, int last) {
+    fprintf(out, "  {\"lookup\": \"%s\", \"lookups\": %d, \"singleNs\": %.1f, \"batchNs\": %.1f, \"speedup\": %.2f}%s\n",
+            lookup, lookups, singleNs / lookups, batchNs / lookups, singleNs / batchNs, last ? "" : ",");
+}
+
+int main(int argc, char *argv[]) {
+    setlocale(LC_ALL, "");
+    int lookups = BENCH_DEFAULT_LOOKUPS, batchSize = BENCH_DEFAULT_BATCH;
+    int argi = 1, badOption = 0;
+    while (argi < argc && strncmp(argv[argi], "--", 2) == 0 && !badOption) {
+        if (argi + 1 >= argc) {
+            badOption = 1;
+        } else if (strcmp(argv[argi], "--lookups") == 0) {
+            lookups = atoi(argv[argi + 1]);
+        } else if (strcmp(argv[argi], "--batch") == 0) {
+            batchSize = atoi(argv[argi + 1]);
+        } else {
+            badOption = 1;
+        }
+        argi += 2;
+    }
+    if (badOption || argc - argi != 2 || lookups <= 0 || batchSize <= 0) {
+        fprintf(stderr, "Usage: %s [--lookups <n>] [--batch <n>] <dictionary_directory> <input_directory>\n",
+                argv[0]);
+        return 1;
+    }
+
+    char *dictFiles[MAX_FILES], *inputs[MAX_FILES];
+    int dictCount = collect_files(argv[argi], dictFiles, NULL);
+    int inputCount = collect_files(argv[argi + 1], inputs, "input");
+    if (dictCount < 0 || inputCount <= 0) {
+        fprintf(stderr, "No input files in %s\n", argv[argi + 1]);
+        return 1;
+    }
+
+    TrieNode *dictionary = buildUnifiedTrie(inputCount, inputs, dictCount, dictFiles);
+    BenchKeys words = { NULL, 0, 0 }, contexts = { NULL, 0, 0 };
+    wchar_t buffer[MAX_WORD_LENGTH];
+    collectWords(dictionary, buffer, 0, &words);
+    ngramTrieNode *bigrams = buildBigrams(inputs, inputCount, &contexts);
+    if (words.count == 0 || contexts.count == 0) {
+        fprintf(stderr, "Nothing to look up\n");
+        return 1;
+    }
+    const wchar_t **wordKeys = drawKeys(&words, lookups), **contextKeys = drawKeys(&contexts, lookups);
+
+    TrieNode **single = malloc(lookups * sizeof(TrieNode *)), **batch = malloc(lookups * sizeof(TrieNode *));
+    int *singleFound = malloc(lookups * sizeof(int)), *batchFound = malloc(lookups * sizeof(int));
+    ngramTrieNode **singleContext = malloc(lookups * sizeof(ngramTrieNode *));
+    ngramTrieNode **batchContext = malloc(lookups * sizeof(ngramTrieNode *));
+    int mismatches = 0;
+    double start, singleNs, batchNs;
+
+    char *text = NULL;
+    size_t textLen = 0;
+    FILE *out = open_memstream(&text, &textLen);
+    fprintf(out, "[\n");
+
+    start = nowNs();
+    for (int i = 0; i < lookups; i++) single[i] = searchPrefix(dictionary, wordKeys[i]);
+    singleNs = nowNs() - start;
+    start = nowNs();
+    for (int i = 0; i < lookups; i += batchSize)
+        searchPrefixBatch(dictionary, wordKeys + i, lookups - i < batchSize ? lookups - i : batchSize, batch + i);
+    batchNs = nowNs() - start;
+    for (int i = 0; i < lookups; i++) mismatches += single[i] != batch[i];
+    writeResult(out, "searchPrefix", lookups, singleNs, batchNs, 0);
+
+    start = nowNs();
+    for (int i = 0; i < lookups; i++) singleFound[i] = searchDict(dictionary, wordKeys[i]);
+    singleNs = nowNs() - start;
+    start = nowNs();
+    for (int i = 0; i < lookups; i += batchSize)
+        searchDictBatch(dictionary, wordKeys + i, lookups - i < batchSize ? lookups - i : batchSize, batchFound + i);
+    batchNs = nowNs() - start;
+    for (int i = 0; i < lookups; i++) mismatches += singleFound[i] != batchFound[i];
+    writeResult(out, "searchDict", lookups, singleNs, batchNs, 0);
+
+    start = nowNs();
+    for (int i = 0; i < lookups; i++) singleContext[i] = traverseContext(bigrams, (wchar_t *)contextKeys[i]);
+    singleNs = nowNs() - start;
+    start = nowNs();
+    for (int i = 0; i < lookups; i += batchSize)
+        traverseContextBatch(bigrams, contextKeys + i, lookups - i < batchSize ? lookups - i : batchSize,
+                             batchContext + i);
+    batchNs = nowNs() - start;
+    for (int i = 0; i < lookups; i++) mismatches += singleContext[i] != batchContext[i];
+    writeResult(out, "traverseContext", lookups, singleNs, batchNs, 1);
+
+    fprintf(out, "]\n");
+    fclose(out);
+    // stdout may be wide-oriented by now (the build code uses wprintf).
+    if (fwide(stdout, 0) > 0) wprintf(L"%s", text);
+    else fputs(text, stdout);
+    free(text);
+
+    if (mismatches) {
+        fprintf(stderr, "%d batch results differ from the single lookups\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
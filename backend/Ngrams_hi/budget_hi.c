@@ -0,0 +1,43 @@
+#include <time.h>
+
+// Per-request time budget. Trie walks call budgetExpired() once per visited
+// node; the clock is only read every BUDGET_CHECK_INTERVAL calls, so the
+// check costs an increment on the common path. Once the deadline passes the
+// walks unwind and the request answers with the results found so far.
+
+#define BUDGET_CHECK_INTERVAL 256
+#define DEFAULT_BUDGET_MICROS 5000
+
+typedef struct RequestBudget {
+    struct timespec deadline;
+    unsigned steps;
+    int expired;
+    int degraded;      // set under load: skip the expensive fuzzy search
+} RequestBudget;
+
+void budgetStart(RequestBudget *budget, long micros, int degraded) {
+    clock_gettime(CLOCK_MONOTONIC, &budget->deadline);
+    budget->deadline.tv_sec += micros / 1000000;
+    budget->deadline.tv_nsec += (micros % 1000000) * 1000;
+    if (budget->deadline.tv_nsec >= 1000000000L) {
+        budget->deadline.tv_sec++;
+        budget->deadline.tv_nsec -= 1000000000L;
+    }
+    budget->steps = 0;
+    budget->expired = 0;
+    budget->degraded = degraded;
+}
+
+// A NULL budget never expires.
+int budgetExpired(RequestBudget *budget) {
+    if (!budget) return 0;
+    if (budget->expired) return 1;
+    if (++budget->steps % BUDGET_CHECK_INTERVAL != 0) return 0;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > budget->deadline.tv_sec ||
+        (now.tv_sec == budget->deadline.tv_sec && now.tv_nsec >= budget->deadline.tv_nsec))
+        budget->expired = 1;
+    return budget->expired;
+}
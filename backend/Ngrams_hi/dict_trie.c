@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <wchar.h>
 #include <wctype.h>
 #include <locale.h>
@@ -11,11 +12,32 @@
 #define MAX_UNIGRAM_SUGGESTIONS 10
 #define MAX_WORD_LENGTH 100
 
+// Word categories, one bit each, from the dictionary file that lists the word
+// (noun.txt, verb.txt, ...). A word listed in several files has several bits.
+#define WORD_NOUN      0x01
+#define WORD_VERB      0x02
+#define WORD_ADJECTIVE 0x04
+#define WORD_ADVERB    0x08
+#define WORD_NAME      0x10
+
+static const struct {
+    const char *name;      // as used in requests
+    const char *file;      // name of the dictionary file, without ".txt"
+    unsigned char bit;
+} wordCategories[] = {
+    { "noun", "noun", WORD_NOUN }, { "verb", "verb", WORD_VERB },
+    { "adjective", "adjective", WORD_ADJECTIVE }, { "adverb", "adverb", WORD_ADVERB },
+    { "name", "hindi_names", WORD_NAME },
+};
+
 // Trie Node definition
 typedef struct TrieNode {
     struct TrieNode *children[MAX_CHILDREN]; // Assuming UTF-8 index mapping
     int isWord;       // 1 if it's a complete dictionary word
     int frequency;    // frequency count for unigram
+    int maxFrequency; // highest frequency in this subtree, for pruning ranked walks
+    unsigned char categories;        // WORD_* bits of this word
+    unsigned char subtreeCategories; // WORD_* bits of any word in this subtree, for pruning filtered walks
 } TrieNode;
 
 typedef struct {
@@ -37,6 +59,9 @@ TrieNode *createTrieNode() {
 
     node->isWord = 0;
     node->frequency = 0;
+    node->maxFrequency = 0;
+    node->categories = 0;
+    node->subtreeCategories = 0;
 
     return node;
 }
@@ -82,11 +107,111 @@ wchar_t **searchUnigramSuggestions(TrieNode *root, int *resultCount) {
     return results;
 }
 
+// Category of the words of a dictionary file, from its name without the
+// ".txt" extension ("adverb.txt" is an adverb file, not a verb file); 0 if no
+// category has that file name.
+unsigned char categoryOfFile(const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    size_t len = strlen(name);
+    if (len > 4 && strcmp(name + len - 4, ".txt") == 0) len -= 4;
+    for (size_t i = 0; i < sizeof(wordCategories) / sizeof(wordCategories[0]); i++)
+        if (strlen(wordCategories[i].file) == len && strncmp(name, wordCategories[i].file, len) == 0)
+            return wordCategories[i].bit;
+    return 0;
+}
+
+// Parses a comma separated list of category names ("name,verb") into WORD_*
+// bits. Returns -1 for an unknown name.
+int parseCategories(const char *list) {
+    int mask = 0;
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        size_t i, count = sizeof(wordCategories) / sizeof(wordCategories[0]);
+        for (i = 0; i < count; i++)
+            if (strlen(wordCategories[i].name) == len && strncmp(list, wordCategories[i].name, len) == 0) break;
+        if (i == count) return -1;
+        mask |= wordCategories[i].bit;
+        list += len;
+        if (*list == ',') list++;
+    }
+    return mask;
+}
+
 int getOffset(wchar_t ch) {
     int offset = ch - UNICODE_BASE;
     return (offset >= 0 && offset < MAX_CHILDREN) ? offset : -1;
 }
 
+// Categories of the dictionary words another shard owns (see shard_hi.c).
+// Words are sharded but their categories are not: an n-gram continuation
+// naming a word of another shard is filtered and boosted as on a single
+// backend. Open addressing on a 64-bit hash of the word's letters, 0 marking
+// a free slot; empty when there is one shard. About 9 bytes per word.
+typedef struct ForeignCategories {
+    uint64_t *hashes;
+    unsigned char *categories;
+    size_t capacity, count;        // capacity is a power of two
+} ForeignCategories;
+
+ForeignCategories foreignCategories;
+
+// FNV-1a over the letters of word that the trie stores.
+uint64_t dictWordHash(const wchar_t *word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *word; word++) {
+        int offset = getOffset(*word);
+        if (offset == -1) continue;
+        hash ^= (uint64_t)offset;
+        hash *= 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+void addForeignCategories(const wchar_t *word, unsigned char categories) {
+    ForeignCategories *table = &foreignCategories;
+    if ((table->count + 1) * 2 > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 4096;
+        uint64_t *hashes = calloc(capacity, sizeof(uint64_t));
+        unsigned char *bits = calloc(capacity, 1);
+        if (!hashes || !bits) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (!table->hashes[i]) continue;
+            size_t slot = table->hashes[i] & (capacity - 1);
+            while (hashes[slot]) slot = (slot + 1) & (capacity - 1);
+            hashes[slot] = table->hashes[i];
+            bits[slot] = table->categories[i];
+        }
+        free(table->hashes);
+        free(table->categories);
+        table->hashes = hashes;
+        table->categories = bits;
+        table->capacity = capacity;
+    }
+
+    uint64_t hash = dictWordHash(word);
+    size_t slot = hash & (table->capacity - 1);
+    while (table->hashes[slot] && table->hashes[slot] != hash) slot = (slot + 1) & (table->capacity - 1);
+    if (!table->hashes[slot]) {
+        table->hashes[slot] = hash;
+        table->count++;
+    }
+    table->categories[slot] |= categories;
+}
+
+// Categories of a dictionary word held by another shard, 0 if unknown.
+unsigned char lookupForeignCategories(const wchar_t *word) {
+    ForeignCategories *table = &foreignCategories;
+    if (!table->count) return 0;
+    uint64_t hash = dictWordHash(word);
+    for (size_t slot = hash & (table->capacity - 1); table->hashes[slot]; slot = (slot + 1) & (table->capacity - 1))
+        if (table->hashes[slot] == hash) return table->categories[slot];
+    return 0;
+}
+
 wchar_t getCharFromIndex(int index) {
     return (wchar_t)(UNICODE_BASE + index);  // Inverse of getOffset
 }
@@ -127,6 +252,7 @@ void insertUnigram(TrieNode *root, const wchar_t *word) {
 void processLine(TrieNode *root, wchar_t *line) {
     const wchar_t *delimiters = L" \t\n\r";
     wchar_t *saveptr = NULL;
+    normalizeDevanagari(line, line, wcslen(line) + 1);
     wchar_t *token = wcstok(line, delimiters, &saveptr);
 
     while (token != NULL) {
@@ -141,7 +267,8 @@ void processLine(TrieNode *root, wchar_t *line) {
         }
 
         if (valid) {
-            insertUnigram(root, token);  // Use frequency field
+            if (ownsWord(token))
+                insertUnigram(root, token);  // Use frequency field
         } else {
             // Debug: Skipped token
             wprintf(L"Skipping invalid token: [%ls]\n", token);
@@ -186,7 +313,7 @@ TrieNode* searchPrefix(TrieNode *root, const wchar_t *prefix) {
 }
 
 
-void insertDictWord(TrieNode *root, const wchar_t *word) {
+void insertDictWord(TrieNode *root, const wchar_t *word, unsigned char categories) {
     TrieNode *curr = root;
     for (int i = 0; word[i] != L'\0'; i++) {
         int offset = getOffset(word[i]);
@@ -198,8 +325,73 @@ void insertDictWord(TrieNode *root, const wchar_t *word) {
         curr = curr->children[offset];
     }
     curr->isWord = 1;
+    curr->categories |= categories;
 }
 
+// Returns the child at offset, creating it if needed. Safe to call while other
+// threads read or learn on the same trie: a new node is published with a single
+// compare-and-swap and the loser of a race frees its copy.
+TrieNode *getOrCreateChild(TrieNode *node, int offset) {
+    TrieNode *child = __atomic_load_n(&node->children[offset], __ATOMIC_ACQUIRE);
+    if (child) return child;
+
+    TrieNode *fresh = createTrieNode();
+    if (__atomic_compare_exchange_n(&node->children[offset], &child, fresh, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+        return fresh;
+
+    free(fresh);
+    return child;
+}
+
+// Runtime counterpart of insertUnigram for accepted suggestions; lock-free so
+// queries keep running while counts are bumped.
+void learnUnigram(TrieNode *root, const wchar_t *word, int delta) {
+    TrieNode *curr = root;
+    for (int i = 0; word[i] != L'\0'; i++) {
+        int offset = getOffset(word[i]);
+        if (offset == -1) continue;
+        curr = getOrCreateChild(curr, offset);
+    }
+    if (curr == root) return;
+    int frequency = __atomic_add_fetch(&curr->frequency, delta, __ATOMIC_RELAXED);
+
+    // Keep the subtree maxima on the path in step with the new count.
+    curr = root;
+    for (int i = 0; word[i] != L'\0'; i++) {
+        int offset = getOffset(word[i]);
+        if (offset == -1) continue;
+        curr = curr->children[offset];
+        int seen = __atomic_load_n(&curr->maxFrequency, __ATOMIC_RELAXED);
+        while (seen < frequency &&
+               !__atomic_compare_exchange_n(&curr->maxFrequency, &seen, frequency, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+}
+
+// Fills in maxFrequency bottom-up once the trie is built.
+int computeMaxFrequency(TrieNode *node) {
+    int max = node->frequency;
+    for (int i = 0; i < MAX_CHILDREN; i++) {
+        if (node->children[i]) {
+            int childMax = computeMaxFrequency(node->children[i]);
+            if (childMax > max) max = childMax;
+        }
+    }
+    node->maxFrequency = max;
+    return max;
+}
+
+// Fills in subtreeCategories bottom-up once the trie is built. Words learned
+// later have no category, so the sets stay valid.
+unsigned char computeSubtreeCategories(TrieNode *node) {
+    unsigned char categories = node->categories;
+    for (int i = 0; i < MAX_CHILDREN; i++)
+        if (node->children[i]) categories |= computeSubtreeCategories(node->children[i]);
+    node->subtreeCategories = categories;
+    return categories;
+}
 
 // Recursive function to display all words in Trie
 void displayTrie(TrieNode *root, wchar_t *buffer, int depth) {
@@ -259,20 +451,27 @@ TrieNode *buildUnifiedTrie(int unigramCount, char *unigramPaths[],int dictCount,
             perror("Error opening dictionary file");
             exit(1);
         }
+        unsigned char categories = categoryOfFile(dictPaths[i]);
 
         while (fgetws(line, sizeof(line) / sizeof(wchar_t), file)) {
             wchar_t *pos;
             if ((pos = wcschr(line, L'\n')) != NULL) *pos = L'\0';
             if ((pos = wcschr(line, L'\r')) != NULL) *pos = L'\0';
 
+            normalizeDevanagari(line, line, wcslen(line) + 1);
             cleanPunctuation(line);
-            if (wcslen(line) > 0)
-                insertDictWord(root, line);  // Only mark isWord=1
+            if (wcslen(line) == 0) continue;
+            if (ownsWord(line))
+                insertDictWord(root, line, categories);
+            else if (categories)
+                addForeignCategories(line, categories);
         }
 
         fclose(file);
     }
 
+    computeMaxFrequency(root);
+    computeSubtreeCategories(root);
     return root;
 }
 
@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// Minimal non-blocking HTTP/1.1 server: one epoll loop, keep-alive and
+// pipelined requests, Content-Length bodies only.
+//
+// The loop only does I/O and parsing. Each complete request becomes a job on
+// a bounded queue served by a pool of worker threads, which call the handler
+// and hand the response back through an eventfd. Every job carries a
+// RequestBudget that starts when the request arrives. When the queue is half
+// full new jobs are degraded (no fuzzy search); when it is full they are
+// rejected with 503 instead of waiting behind the backlog.
+
+#define HTTP_MAX_EVENTS 64
+#define HTTP_MAX_HEADER 8192
+#define HTTP_MAX_BODY (64 * 1024)
+#define HTTP_READ_CHUNK 4096
+#define HTTP_QUEUE_CAPACITY 128
+#define HTTP_DEFAULT_WORKERS 4
+
+typedef struct HttpResponse {
+    int status;
+    const char *contentType;
+    char *body;            // malloc'ed by the handler, freed by the server
+    size_t bodyLen;
+} HttpResponse;
+
+typedef void (*HttpHandler)(void *ctx, const char *method, const char *path,
+                            const char *body, size_t bodyLen, RequestBudget *budget,
+                            HttpResponse *response);
+
+typedef struct HttpConnection {
+    int fd;
+    char *in;
+    size_t inLen, inCap;
+    char *out;
+    size_t outLen, outSent, outCap;
+    int closeAfterWrite;
+    int busy;              // a job for this connection is queued or running
+    int closed;            // socket closed; memory is released after the current epoll batch
+    struct HttpConnection *nextClosed;
+} HttpConnection;
+
+typedef struct HttpJob {
+    HttpConnection *conn;
+    char method[16];
+    char path[256];
+    char *body;
+    size_t bodyLen;
+    int keepAlive;
+    RequestBudget budget;
+    HttpResponse response;
+    struct HttpJob *next;
+} HttpJob;
+
+typedef struct HttpServer {
+    int listenFd;
+    int epollFd;
+    int wakeFd;            // eventfd signalled when jobs complete
+    HttpHandler handler;
+    void *ctx;
+    long budgetMicros;
+    int workerCount;
+
+    pthread_mutex_t queueLock;
+    pthread_cond_t queueReady;
+    HttpJob *queueHead, *queueTail;
+    int queueDepth;
+
+    pthread_mutex_t doneLock;
+    HttpJob *doneHead;
+
+    HttpConnection *closedHead;   // closed connections, freed between epoll batches
+} HttpServer;
+
+const char *httpStatusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+    }
+}
+
+void httpReserve(char **buf, size_t *cap, size_t needed) {
+    if (needed <= *cap) return;
+    size_t grown = *cap ? *cap : 1024;
+    while (grown < needed) grown *= 2;
+    char *p = realloc(*buf, grown);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *buf = p;
+    *cap = grown;
+}
+
+void httpAppend(HttpConnection *conn, const char *data, size_t len) {
+    httpReserve(&conn->out, &conn->outCap, conn->outLen + len);
+    memcpy(conn->out + conn->outLen, data, len);
+    conn->outLen += len;
+}
+
+void httpQueueResponse(HttpConnection *conn, HttpResponse *response, int keepAlive) {
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %d %s\r\n"
+                       "Content-Type: %s\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Access-Control-Allow-Origin: *\r\n"
+                       "Connection: %s\r\n\r\n",
+                       response->status, httpStatusText(response->status),
+                       response->contentType ? response->contentType : "application/json",
+                       response->bodyLen, keepAlive ? "keep-alive" : "close");
+    httpAppend(conn, header, len);
+    if (response->bodyLen) httpAppend(conn, response->body, response->bodyLen);
+    if (!keepAlive) conn->closeAfterWrite = 1;
+}
+
+void httpQueueError(HttpConnection *conn, int status, int keepAlive) {
+    char body[64];
+    HttpResponse response = { status, "application/json", body, 0 };
+    response.bodyLen = snprintf(body, sizeof(body), "{\"error\": \"%s\"}", httpStatusText(status));
+    httpQueueResponse(conn, &response, keepAlive);
+}
+
+// Case-insensitive lookup of a header value inside the header block. Copies
+// at most size-1 bytes of the value into out; returns 1 if present.
+int httpHeader(const char *headers, size_t len, const char *name, char *out, size_t size) {
+    size_t nameLen = strlen(name);
+    const char *end = headers + len;
+    for (const char *line = headers; line < end; ) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        if ((size_t)(eol - line) > nameLen && strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+            const char *v = line + nameLen + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            size_t vlen = eol - v;
+            while (vlen > 0 && (v[vlen - 1] == '\r' || v[vlen - 1] == ' ')) vlen--;
+            if (vlen >= size) vlen = size - 1;
+            memcpy(out, v, vlen);
+            out[vlen] = '\0';
+            return 1;
+        }
+        line = eol + 1;
+    }
+    return 0;
+}
+
+// Queues a parsed request for the workers, or rejects it when the queue is full.
+void httpSubmit(HttpServer *server, HttpConnection *conn, const char *method, const char *path,
+                const char *body, size_t bodyLen, int keepAlive) {
+    pthread_mutex_lock(&server->queueLock);
+    int depth = server->queueDepth;
+    if (depth >= HTTP_QUEUE_CAPACITY) {
+        pthread_mutex_unlock(&server->queueLock);
+        httpQueueError(conn, 503, keepAlive);
+        return;
+    }
+
+    HttpJob *job = calloc(1, sizeof(HttpJob));
+    char *bodyCopy = malloc(bodyLen + 1);
+    if (!job || !bodyCopy) {
+        pthread_mutex_unlock(&server->queueLock);
+        free(job);
+        free(bodyCopy);
+        httpQueueError(conn, 503, keepAlive);
+        return;
+    }
+    job->conn = conn;
+    snprintf(job->method, sizeof(job->method), "%s", method);
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    memcpy(bodyCopy, body, bodyLen);
+    bodyCopy[bodyLen] = '\0';
+    job->body = bodyCopy;
+    job->bodyLen = bodyLen;
+    job->keepAlive = keepAlive;
+    budgetStart(&job->budget, server->budgetMicros, depth >= HTTP_QUEUE_CAPACITY / 2);
+
+    if (server->queueTail) server->queueTail->next = job;
+    else server->queueHead = job;
+    server->queueTail = job;
+    server->queueDepth++;
+    conn->busy = 1;
+    pthread_cond_signal(&server->queueReady);
+    pthread_mutex_unlock(&server->queueLock);
+}
+
+// Parses complete requests from the input buffer. Only one request per
+// connection is in flight at a time, which keeps pipelined responses in order.
+// Malformed requests get an error response and the connection is closed.
+void httpProcessInput(HttpServer *server, HttpConnection *conn) {
+    while (conn->inLen > 0 && !conn->closeAfterWrite && !conn->busy) {
+        char *headerEnd = NULL;
+        for (size_t i = 3; i < conn->inLen; i++) {
+            if (conn->in[i] == '\n' && conn->in[i - 1] == '\r' && conn->in[i - 2] == '\n' && conn->in[i - 3] == '\r') {
+                headerEnd = conn->in + i + 1;
+                break;
+            }
+        }
+        if (!headerEnd) {
+            if (conn->inLen > HTTP_MAX_HEADER) httpQueueError(conn, 413, 0);
+            return;   // otherwise wait for more data
+        }
+
+        size_t headerLen = headerEnd - conn->in;
+        char method[16], path[256], version[16];
+        if (sscanf(conn->in, "%15s %255s %15s", method, path, version) != 3) {
+            httpQueueError(conn, 400, 0);
+            return;
+        }
+
+        char value[64];
+        size_t contentLength = 0;
+        if (httpHeader(conn->in, headerLen, "Content-Length", value, sizeof(value)))
+            contentLength = strtoul(value, NULL, 10);
+        if (contentLength > HTTP_MAX_BODY) {
+            httpQueueError(conn, 413, 0);
+            return;
+        }
+        if (conn->inLen < headerLen + contentLength) return;   // body incomplete
+
+        int keepAlive = strcmp(version, "HTTP/1.1") == 0;
+        if (httpHeader(conn->in, headerLen, "Connection", value, sizeof(value)))
+            keepAlive = strcasecmp(value, "close") != 0 && (keepAlive || strcasecmp(value, "keep-alive") == 0);
+
+        httpSubmit(server, conn, method, path, headerEnd, contentLength, keepAlive);
+
+        size_t consumed = headerLen + contentLength;
+        memmove(conn->in, conn->in + consumed, conn->inLen - consumed);
+        conn->inLen -= consumed;
+    }
+}
+
+// Later events of the same epoll batch may still point at a closed connection,
+// so it is only released once the batch is done (and its job, if any, returned).
+void httpRelease(HttpServer *server, HttpConnection *conn) {
+    conn->nextClosed = server->closedHead;
+    server->closedHead = conn;
+}
+
+void httpClose(HttpServer *server, HttpConnection *conn) {
+    if (conn->closed) return;
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->closed = 1;
+    if (!conn->busy) httpRelease(server, conn);   // otherwise the completing job does
+}
+
+// Sends as much pending output as the socket takes. Returns -1 when the
+// connection is finished (error or response sent with Connection: close).
+int httpFlush(HttpServer *server, HttpConnection *conn) {
+    while (conn->outSent < conn->outLen) {
+        ssize_t n = send(conn->fd, conn->out + conn->outSent, conn->outLen - conn->outSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        conn->outSent += n;
+    }
+
+    struct epoll_event ev = { 0 };
+    ev.data.ptr = conn;
+    if (conn->outSent < conn->outLen) {
+        ev.events = EPOLLIN | EPOLLOUT;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+        return 0;
+    }
+
+    conn->outLen = conn->outSent = 0;
+    if (conn->closeAfterWrite && !conn->busy) return -1;
+    ev.events = EPOLLIN;
+    epoll_ctl(server->epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+    return 0;
+}
+
+int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void httpAccept(HttpServer *server) {
+    while (1) {
+        int fd = accept(server->listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                LOG(LOG_ERROR, L"accept failed: %s", strerror(errno));
+            return;
+        }
+        setNonBlocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        HttpConnection *conn = calloc(1, sizeof(HttpConnection));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        struct epoll_event ev = { 0 };
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+void httpRead(HttpServer *server, HttpConnection *conn) {
+    int peerClosed = 0;
+    while (1) {
+        httpReserve(&conn->in, &conn->inCap, conn->inLen + HTTP_READ_CHUNK);
+        ssize_t n = recv(conn->fd, conn->in + conn->inLen, HTTP_READ_CHUNK, 0);
+        if (n > 0) {
+            conn->inLen += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) {
+            httpClose(server, conn);
+            return;
+        }
+        peerClosed = 1;   // answer what was sent, then close
+        break;
+    }
+
+    httpProcessInput(server, conn);
+    if (peerClosed) {
+        conn->closeAfterWrite = 1;
+        // Stop polling a half-closed socket; the pending job re-arms it.
+        struct epoll_event ev = { 0 };
+        ev.data.ptr = conn;
+        epoll_ctl(server->epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+        if (conn->busy) return;
+    }
+    if (httpFlush(server, conn) != 0) httpClose(server, conn);
+}
+
+void *httpWorker(void *arg) {
+    HttpServer *server = arg;
+    while (1) {
+        pthread_mutex_lock(&server->queueLock);
+        while (!server->queueHead)
+            pthread_cond_wait(&server->queueReady, &server->queueLock);
+        HttpJob *job = server->queueHead;
+        server->queueHead = job->next;
+        if (!server->queueHead) server->queueTail = NULL;
+        server->queueDepth--;
+        pthread_mutex_unlock(&server->queueLock);
+
+        job->response.status = 500;
+        job->response.contentType = "application/json";
+        server->handler(server->ctx, job->method, job->path, job->body, job->bodyLen,
+                        &job->budget, &job->response);
+
+        pthread_mutex_lock(&server->doneLock);
+        job->next = server->doneHead;
+        server->doneHead = job;
+        pthread_mutex_unlock(&server->doneLock);
+        uint64_t one = 1;
+        if (write(server->wakeFd, &one, sizeof(one)) < 0) perror("eventfd write failed");
+    }
+    return NULL;
+}
+
+// Runs on the event loop: attaches finished responses to their connections.
+void httpCompleteJobs(HttpServer *server) {
+    uint64_t ignored;
+    if (read(server->wakeFd, &ignored, sizeof(ignored)) < 0 && errno != EAGAIN)
+        perror("eventfd read failed");
+
+    pthread_mutex_lock(&server->doneLock);
+    HttpJob *done = server->doneHead;
+    server->doneHead = NULL;
+    pthread_mutex_unlock(&server->doneLock);
+
+    while (done) {
+        HttpJob *job = done;
+        done = job->next;
+        HttpConnection *conn = job->conn;
+        conn->busy = 0;
+
+        if (conn->closed) {
+            httpRelease(server, conn);
+        } else {
+            httpQueueResponse(conn, &job->response, job->keepAlive);
+            httpProcessInput(server, conn);   // next pipelined request, if any
+            if (httpFlush(server, conn) != 0) httpClose(server, conn);
+        }
+        free(job->response.body);
+        free(job->body);
+        free(job);
+    }
+}
+
+// Binds "[address:]port" (address defaults to 127.0.0.1) and starts the
+// worker threads. Returns 0 on success.
+int httpServerInit(HttpServer *server, const char *listenSpec, int workers, long budgetMicros,
+                   HttpHandler handler, void *ctx) {
+    char address[64] = "127.0.0.1";
+    const char *colon = strrchr(listenSpec, ':');
+    int port = atoi(colon ? colon + 1 : listenSpec);
+    if (colon && (size_t)(colon - listenSpec) < sizeof(address)) {
+        memcpy(address, listenSpec, colon - listenSpec);
+        address[colon - listenSpec] = '\0';
+    }
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid HTTP listen address: %s\n", listenSpec);
+        return -1;
+    }
+
+    server->handler = handler;
+    server->ctx = ctx;
+    server->budgetMicros = budgetMicros;
+    server->workerCount = workers > 0 ? workers : HTTP_DEFAULT_WORKERS;
+    server->queueHead = server->queueTail = server->doneHead = NULL;
+    server->closedHead = NULL;
+    server->queueDepth = 0;
+    pthread_mutex_init(&server->queueLock, NULL);
+    pthread_cond_init(&server->queueReady, NULL);
+    pthread_mutex_init(&server->doneLock, NULL);
+
+    server->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (server->listenFd < 0 || bind(server->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listenFd, SOMAXCONN) != 0) {
+        perror("HTTP listen failed");
+        return -1;
+    }
+    setNonBlocking(server->listenFd);
+
+    server->epollFd = epoll_create1(0);
+    server->wakeFd = eventfd(0, EFD_NONBLOCK);
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;     // NULL marks the listening socket
+    epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->listenFd, &ev);
+    ev.data.ptr = server;   // the server itself marks the completion eventfd
+    epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->wakeFd, &ev);
+
+    for (int i = 0; i < server->workerCount; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, httpWorker, server) != 0) {
+            perror("Cannot start HTTP worker");
+            return -1;
+        }
+        pthread_detach(worker);
+    }
+    fprintf(stderr, "HTTP server listening on %s:%d with %d workers\n", address, port, server->workerCount);
+    return 0;
+}
+
+void *httpServerRun(void *arg) {
+    HttpServer *server = arg;
+    struct epoll_event events[HTTP_MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(server->epollFd, events, HTTP_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (!tag) {
+                httpAccept(server);
+                continue;
+            }
+            if (tag == server) {
+                httpCompleteJobs(server);
+                continue;
+            }
+            HttpConnection *conn = tag;
+            if (conn->closed) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                httpClose(server, conn);
+            } else if (events[i].events & EPOLLIN) {
+                httpRead(server, conn);
+            } else if (events[i].events & EPOLLOUT) {
+                if (httpFlush(server, conn) != 0) httpClose(server, conn);
+            }
+        }
+
+        while (server->closedHead) {
+            HttpConnection *conn = server->closedHead;
+            server->closedHead = conn->nextClosed;
+            free(conn->in);
+            free(conn->out);
+            free(conn);
+        }
+    }
+    return NULL;
+}
+
+
+// Decodes the JSON string starting at the opening quote *p into out as
+// UTF-8 and moves *p past the closing quote. Returns 0 if *p is not a string.
+int jsonReadString(const char **p, const char *end, char *out, size_t size) {
+    const char *v = *p;
+    if (v >= end || *v != '"') return 0;
+    v++;
+
+    size_t o = 0;
+    while (v < end && *v != '"' && o + 4 < size) {
+        if (*v != '\\') {
+            out[o++] = *v++;
+            continue;
+        }
+        if (++v >= end) break;
+        char esc = *v++;
+        if (esc == 'u' && v + 4 <= end) {
+            unsigned cp = strtoul((char[]){ v[0], v[1], v[2], v[3], 0 }, NULL, 16);
+            v += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF && v + 6 <= end && v[0] == '\\' && v[1] == 'u') {
+                unsigned lo = strtoul((char[]){ v[2], v[3], v[4], v[5], 0 }, NULL, 16);
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                v += 6;
+            }
+            if (cp < 0x80) {
+                out[o++] = cp;
+            } else if (cp < 0x800) {
+                out[o++] = 0xC0 | (cp >> 6);
+                out[o++] = 0x80 | (cp & 0x3F);
+            } else if (cp < 0x10000) {
+                out[o++] = 0xE0 | (cp >> 12);
+                out[o++] = 0x80 | ((cp >> 6) & 0x3F);
+                out[o++] = 0x80 | (cp & 0x3F);
+            } else {
+                out[o++] = 0xF0 | (cp >> 18);
+                out[o++] = 0x80 | ((cp >> 12) & 0x3F);
+                out[o++] = 0x80 | ((cp >> 6) & 0x3F);
+                out[o++] = 0x80 | (cp & 0x3F);
+            }
+        } else {
+            switch (esc) {
+                case 'n': out[o++] = '\n'; break;
+                case 't': out[o++] = '\t'; break;
+                case 'r': out[o++] = '\r'; break;
+                case 'b': out[o++] = '\b'; break;
+                case 'f': out[o++] = '\f'; break;
+                default:  out[o++] = esc; break;
+            }
+        }
+    }
+    out[o] = '\0';
+    while (v < end && *v != '"') v++;    // the rest of a value too long for out
+    *p = v < end ? v + 1 : end;
+    return 1;
+}
+
+// Extracts the string value of "key" from a flat JSON object as UTF-8.
+// Returns 1 if found.
+int jsonGetString(const char *json, size_t len, const char *key, char *out, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    size_t patternLen = strlen(pattern);
+    const char *end = json + len;
+
+    for (const char *p = json; p + patternLen <= end; p++) {
+        if (memcmp(p, pattern, patternLen) != 0) continue;
+        const char *v = p + patternLen;
+        while (v < end && (*v == ' ' || *v == '\t' || *v == '\r' || *v == '\n')) v++;
+        if (v >= end || *v != ':') continue;
+        v++;
+        while (v < end && (*v == ' ' || *v == '\t' || *v == '\r' || *v == '\n')) v++;
+        return jsonReadString(&v, end, out, size);
+    }
+    return 0;
+}
+
+// Returns 1 if "key" is present with the value true.
+int jsonGetBool(const char *json, size_t len, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    size_t patternLen = strlen(pattern);
+    const char *end = json + len;
+
+    for (const char *p = json; p + patternLen <= end; p++) {
+        if (memcmp(p, pattern, patternLen) != 0) continue;
+        const char *v = p + patternLen;
+        while (v < end && (*v == ' ' || *v == ':' || *v == '\t')) v++;
+        return v + 4 <= end && memcmp(v, "true", 4) == 0;
+    }
+    return 0;
+}
+
+// Appends s to the JSON buffer as a quoted, escaped string.
+void jsonAppendString(FILE *json, const char *s) {
+    fputc('"', json);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') fprintf(json, "\\%c", c);
+        else if (c < 0x20) fprintf(json, "\\u%04x", c);
+        else fputc(c, json);
+    }
+    fputc('"', json);
+}
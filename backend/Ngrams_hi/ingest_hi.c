@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+// Manifest of the corpus files a model holds, by content hash.
+//
+// A full build rewrites "<prefix>manifest.txt" with every input file it read.
+// "!ingest" then reads only the input files whose content hash is not listed,
+// merges their counts into the live model and appends them to the manifest,
+// so its cost follows the new data only. A file that is edited after it was
+// ingested hashes differently and is counted again as a new file; the old
+// counts go away at the next full build (a restart).
+//
+// File layout: one "<16 hex digits hash> <path>" line per file.
+
+typedef struct IngestManifest {
+    char path[64];
+    uint64_t *hashes;
+    int count, capacity;
+} IngestManifest;
+
+// FNV-1a over the bytes of the file. Returns 0 on success.
+int hashFileContents(const char *path, uint64_t *hash) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+
+    unsigned char buffer[65536];
+    size_t n;
+    *hash = 14695981039346656037ull;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            *hash ^= buffer[i];
+            *hash *= 1099511628211ull;
+        }
+    }
+    int failed = ferror(file);
+    fclose(file);
+    return failed ? -1 : 0;
+}
+
+int manifestContains(IngestManifest *manifest, uint64_t hash) {
+    for (int i = 0; i < manifest->count; i++)
+        if (manifest->hashes[i] == hash) return 1;
+    return 0;
+}
+
+// Lists hash in memory and, when filePath is given, in the manifest file.
+int manifestAdd(IngestManifest *manifest, uint64_t hash, const char *filePath) {
+    if (manifest->count == manifest->capacity) {
+        int capacity = manifest->capacity ? manifest->capacity * 2 : 64;
+        uint64_t *grown = realloc(manifest->hashes, capacity * sizeof(uint64_t));
+        if (!grown) return -1;
+        manifest->hashes = grown;
+        manifest->capacity = capacity;
+    }
+    manifest->hashes[manifest->count++] = hash;
+    if (!filePath) return 0;
+
+    FILE *out = fopen(manifest->path, "a");
+    if (!out) {
+        perror("Error opening ingest manifest");
+        return -1;
+    }
+    fprintf(out, "%016" PRIx64 " %s\n", hash, filePath);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Starts the manifest of a full build from files[0..count), replacing any
+// previous one.
+void manifestRebuild(IngestManifest *manifest, const char *prefix, int count, char **files) {
+    snprintf(manifest->path, sizeof(manifest->path), "%smanifest.txt", prefix);
+    manifest->count = 0;
+
+    FILE *out = fopen(manifest->path, "w");
+    if (!out) {
+        perror("Error writing ingest manifest");
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        uint64_t hash;
+        if (hashFileContents(files[i], &hash) != 0 || manifestContains(manifest, hash)) continue;
+        manifestAdd(manifest, hash, NULL);
+        fprintf(out, "%016" PRIx64 " %s\n", hash, files[i]);
+    }
+    fclose(out);
+}
@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+// Write-ahead log of learned counts.
+//
+// Every accepted suggestion is appended to learned.log as a small binary
+// record. A background thread writes and fsyncs the pending records as one
+// group every LEARN_LOG_GROUP_COMMIT_MS; each record has a sequence number,
+// and learnLogWait() returns once the group holding it is on disk, so an
+// acknowledged count survives a crash. Periodically the flusher rotates the
+// log to learned.log.old and a second thread folds that into learned.base,
+// which holds one aggregated record per distinct phrase, while commits go on.
+// At startup the base and then the logs are replayed on top of the corpus
+// model, so recovery costs time proportional to the learned data only.
+//
+// File layout (host byte order):
+//   header: uint32 magic, uint32 generation
+//   record: uint32 payloadLen, uint32 checksum, payload
+//   payload: uint32 count, uint8 modelNameLen, modelName, UTF-8 text
+//
+// Each log carries a generation number; the base records the generation of the
+// last log folded into it, so a log that was already folded is never replayed.
+
+#define LEARN_LOG_FILE "learned.log"
+#define LEARN_LOG_OLD_FILE "learned.log.old"
+#define LEARN_BASE_FILE "learned.base"
+#define LEARN_BASE_TMP_FILE "learned.base.tmp"
+#define LEARN_LOG_MAGIC 0x474f4c48u           // "HLOG"
+#define LEARN_LOG_HEADER_SIZE 8
+#define LEARN_LOG_GROUP_COMMIT_MS 10
+#define LEARN_LOG_COMPACT_SECONDS 300
+#define LEARN_LOG_COMPACT_MIN_BYTES (64 * 1024)
+#define LEARN_RECORD_MAX 2048
+
+typedef void (*LearnApplyFn)(void *ctx, const char *modelName, const wchar_t *text, int count);
+
+typedef struct LearnLog {
+    int fd;
+    uint32_t generation;
+    off_t size;                 // bytes in the current log, header included
+    char *pending;              // records waiting for the next group commit
+    size_t pendingLen, pendingCap;
+    uint64_t appended;          // sequence number of the last queued record
+    uint64_t committed;         // sequence number of the last record on disk
+    int failed;                 // a group commit failed; nothing more is logged
+    time_t lastCompaction;
+    uint32_t foldGeneration;    // generation of learned.log.old still to fold, 0 if none
+    int foldRequested;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t committedChanged;
+    pthread_cond_t foldWake;
+    pthread_t flusher;
+    pthread_t compactor;
+} LearnLog;
+
+uint32_t learnChecksum(const unsigned char *data, size_t len) {
+    uint32_t hash = 2166136261u;   // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int writeFully(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void syncDirectory(void) {
+    int dirfd = open(".", O_RDONLY);
+    if (dirfd >= 0) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+}
+
+// Encodes one record into out (at least LEARN_RECORD_MAX bytes). Returns its
+// size, or 0 if the text does not convert or does not fit.
+size_t encodeLearnRecord(unsigned char *out, const char *modelName, const char *text, uint32_t count) {
+    size_t nameLen = strlen(modelName), textLen = strlen(text);
+    if (nameLen > 255) nameLen = 255;
+
+    uint32_t payloadLen = 4 + 1 + nameLen + textLen;
+    if (8 + payloadLen > LEARN_RECORD_MAX) return 0;
+
+    unsigned char *payload = out + 8;
+    memcpy(payload, &count, 4);
+    payload[4] = (unsigned char)nameLen;
+    memcpy(payload + 5, modelName, nameLen);
+    memcpy(payload + 5 + nameLen, text, textLen);
+
+    uint32_t checksum = learnChecksum(payload, payloadLen);
+    memcpy(out, &payloadLen, 4);
+    memcpy(out + 4, &checksum, 4);
+    return 8 + payloadLen;
+}
+
+// Calls fn for each record of a log or base file. Stops at the first torn or
+// corrupt record (a crash mid-append) and reports where the valid data ends.
+// Returns 0 on success, -1 if the file is missing or has a bad header.
+typedef void (*LearnRecordFn)(void *ctx, const char *modelName, const char *text, uint32_t count);
+
+int readLearnFile(const char *path, uint32_t *generation, LearnRecordFn fn, void *ctx, off_t *validEnd) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return -1;
+
+    uint32_t header[2];
+    if (fread(header, 4, 2, file) != 2 || header[0] != LEARN_LOG_MAGIC) {
+        fprintf(stderr, "Ignoring %s: bad header\n", path);
+        fclose(file);
+        return -1;
+    }
+    *generation = header[1];
+
+    off_t end = LEARN_LOG_HEADER_SIZE;
+    unsigned char payload[LEARN_RECORD_MAX];
+    char modelName[256], text[LEARN_RECORD_MAX];
+    uint32_t meta[2];
+    while (fread(meta, 4, 2, file) == 2) {
+        uint32_t payloadLen = meta[0];
+        if (payloadLen < 5 || payloadLen > LEARN_RECORD_MAX - 8) break;
+        if (fread(payload, 1, payloadLen, file) != payloadLen) break;
+        if (learnChecksum(payload, payloadLen) != meta[1]) break;
+
+        uint32_t count;
+        memcpy(&count, payload, 4);
+        size_t nameLen = payload[4];
+        if (5 + nameLen > payloadLen) break;
+        memcpy(modelName, payload + 5, nameLen);
+        modelName[nameLen] = '\0';
+        memcpy(text, payload + 5 + nameLen, payloadLen - 5 - nameLen);
+        text[payloadLen - 5 - nameLen] = '\0';
+
+        fn(ctx, modelName, text, count);
+        end += 8 + payloadLen;
+    }
+
+    if (validEnd) *validEnd = end;
+    fclose(file);
+    return 0;
+}
+
+// Aggregation table used when folding a log into the base: one entry per
+// (model, phrase) key, stored as "model\0text".
+typedef struct LearnEntry {
+    char *key;
+    size_t keyLen;
+    uint64_t count;
+} LearnEntry;
+
+typedef struct LearnTable {
+    LearnEntry *entries;
+    size_t capacity, used;
+} LearnTable;
+
+void learnTableAdd(LearnTable *table, const char *key, size_t keyLen, uint64_t count) {
+    if ((table->used + 1) * 2 > table->capacity) {
+        LearnTable grown;
+        grown.capacity = table->capacity ? table->capacity * 2 : 1024;
+        grown.entries = calloc(grown.capacity, sizeof(LearnEntry));
+        grown.used = 0;
+        if (!grown.entries) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < table->capacity; i++) {
+            LearnEntry *e = &table->entries[i];
+            if (!e->key) continue;
+            size_t slot = learnChecksum((unsigned char *)e->key, e->keyLen) & (grown.capacity - 1);
+            while (grown.entries[slot].key) slot = (slot + 1) & (grown.capacity - 1);
+            grown.entries[slot] = *e;
+            grown.used++;
+        }
+        free(table->entries);
+        *table = grown;
+    }
+
+    size_t slot = learnChecksum((const unsigned char *)key, keyLen) & (table->capacity - 1);
+    while (table->entries[slot].key) {
+        LearnEntry *e = &table->entries[slot];
+        if (e->keyLen == keyLen && memcmp(e->key, key, keyLen) == 0) {
+            e->count += count;
+            return;
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    LearnEntry *e = &table->entries[slot];
+    e->key = malloc(keyLen);
+    memcpy(e->key, key, keyLen);
+    e->keyLen = keyLen;
+    e->count = count;
+    table->used++;
+}
+
+void learnTableCollect(void *ctx, const char *modelName, const char *text, uint32_t count) {
+    char key[LEARN_RECORD_MAX + 256];
+    size_t nameLen = strlen(modelName), textLen = strlen(text);
+    memcpy(key, modelName, nameLen + 1);
+    memcpy(key + nameLen + 1, text, textLen);
+    learnTableAdd((LearnTable *)ctx, key, nameLen + 1 + textLen, count);
+}
+
+// Rewrites learned.base as base + the records of logPath, then removes logPath.
+// The new base is written to a temporary file and renamed into place, so a
+// crash leaves either the old or the new base intact.
+int foldLogIntoBase(const char *logPath, uint32_t logGeneration) {
+    LearnTable table = { NULL, 0, 0 };
+    uint32_t generation;
+    readLearnFile(LEARN_BASE_FILE, &generation, learnTableCollect, &table, NULL);
+    readLearnFile(logPath, &generation, learnTableCollect, &table, NULL);
+
+    int fd = open(LEARN_BASE_TMP_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error creating learned base");
+        return -1;
+    }
+
+    int failed = 0;
+    uint32_t header[2] = { LEARN_LOG_MAGIC, logGeneration };
+    failed |= writeFully(fd, header, sizeof(header));
+    unsigned char record[LEARN_RECORD_MAX];
+    for (size_t i = 0; i < table.capacity; i++) {
+        LearnEntry *e = &table.entries[i];
+        if (!e->key) continue;
+        const char *text = e->key + strlen(e->key) + 1;
+        char textBuf[LEARN_RECORD_MAX];
+        size_t textLen = e->keyLen - (text - e->key);
+        memcpy(textBuf, text, textLen);
+        textBuf[textLen] = '\0';
+
+        // Counts beyond 32 bits are split over several records.
+        for (uint64_t left = e->count; left > 0 && !failed; ) {
+            uint32_t chunk = left > UINT32_MAX ? UINT32_MAX : (uint32_t)left;
+            size_t len = encodeLearnRecord(record, e->key, textBuf, chunk);
+            if (len) failed |= writeFully(fd, record, len);
+            left -= chunk;
+        }
+        free(e->key);
+    }
+    free(table.entries);
+
+    if (failed || fsync(fd) != 0) {
+        perror("Error writing learned base");
+        close(fd);
+        unlink(LEARN_BASE_TMP_FILE);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(LEARN_BASE_TMP_FILE, LEARN_BASE_FILE) != 0) {
+        perror("Error replacing learned base");
+        return -1;
+    }
+    syncDirectory();
+    unlink(logPath);
+    return 0;
+}
+
+int openLearnLogFile(LearnLog *log, off_t validEnd) {
+    log->fd = open(LEARN_LOG_FILE, O_WRONLY | O_CREAT, 0644);
+    if (log->fd < 0) {
+        perror("Error opening learned log");
+        return -1;
+    }
+
+    if (validEnd == 0) {
+        uint32_t header[2] = { LEARN_LOG_MAGIC, log->generation };
+        if (ftruncate(log->fd, 0) != 0 || writeFully(log->fd, header, sizeof(header)) != 0) {
+            perror("Error writing learned log");
+            close(log->fd);
+            log->fd = -1;
+            return -1;
+        }
+        fsync(log->fd);
+        syncDirectory();
+        log->size = sizeof(header);
+    } else {
+        // Drop a torn tail left by a crash before appending after it.
+        if (ftruncate(log->fd, validEnd) != 0) perror("Error truncating learned log");
+        lseek(log->fd, validEnd, SEEK_SET);
+        log->size = validEnd;
+    }
+    return 0;
+}
+
+typedef struct LearnReplay {
+    LearnApplyFn apply;
+    void *ctx;
+    long records;
+} LearnReplay;
+
+void replayLearnRecord(void *ctx, const char *modelName, const char *text, uint32_t count) {
+    LearnReplay *replay = ctx;
+    wchar_t wtext[LEARN_RECORD_MAX];
+    if (mbstowcs(wtext, text, LEARN_RECORD_MAX - 1) == (size_t)-1) return;
+    wtext[LEARN_RECORD_MAX - 1] = L'\0';
+    replay->apply(replay->ctx, modelName, wtext, (int)count);
+    replay->records++;
+}
+
+void countLearnRecord(void *ctx, const char *modelName, const char *text, uint32_t count) {
+    (void)modelName; (void)text; (void)count;
+    (*(long *)ctx)++;
+}
+
+// Recovers the learned counts in the working directory through apply and
+// opens the log for appending. Returns 0 on success.
+int learnLogOpen(LearnLog *log, LearnApplyFn apply, void *ctx) {
+    uint32_t baseGeneration = 0, oldGeneration = 0, logGeneration = 0;
+    long ignored = 0;
+
+    log->fd = -1;
+    log->pending = NULL;
+    log->pendingLen = log->pendingCap = 0;
+    log->appended = log->committed = 0;
+    log->failed = 0;
+    log->lastCompaction = time(NULL);
+    log->foldGeneration = 0;
+    log->foldRequested = 0;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    pthread_cond_init(&log->committedChanged, NULL);
+    pthread_cond_init(&log->foldWake, NULL);
+
+    readLearnFile(LEARN_BASE_FILE, &baseGeneration, countLearnRecord, &ignored, NULL);
+
+    // A compaction interrupted after rotating the log: finish folding it. An
+    // old log the base already covers is removed; one that cannot be folded
+    // now is replayed on its own and kept for the compactor to retry.
+    if (readLearnFile(LEARN_LOG_OLD_FILE, &oldGeneration, countLearnRecord, &ignored, NULL) == 0) {
+        if (oldGeneration <= baseGeneration)
+            unlink(LEARN_LOG_OLD_FILE);
+        else if (foldLogIntoBase(LEARN_LOG_OLD_FILE, oldGeneration) == 0)
+            baseGeneration = oldGeneration;
+        else
+            log->foldGeneration = oldGeneration;
+    }
+
+    LearnReplay replay = { apply, ctx, 0 };
+    readLearnFile(LEARN_BASE_FILE, &baseGeneration, replayLearnRecord, &replay, NULL);
+    uint32_t covered = baseGeneration;
+    if (log->foldGeneration) {
+        readLearnFile(LEARN_LOG_OLD_FILE, &oldGeneration, replayLearnRecord, &replay, NULL);
+        covered = oldGeneration;
+    }
+    long baseRecords = replay.records;
+
+    off_t validEnd = 0;
+    if (readLearnFile(LEARN_LOG_FILE, &logGeneration, countLearnRecord, &ignored, NULL) == 0 &&
+        logGeneration > covered) {
+        readLearnFile(LEARN_LOG_FILE, &logGeneration, replayLearnRecord, &replay, &validEnd);
+        log->generation = logGeneration;
+    } else {
+        log->generation = covered + 1;
+    }
+
+    fprintf(stderr, "Learned counts recovered: %ld base records, %ld log records\n",
+            baseRecords, replay.records - baseRecords);
+    return openLearnLogFile(log, validEnd);
+}
+
+// Queues one learned phrase for the next group commit. Returns its sequence
+// number for learnLogWait(), or 0 if it will not be logged.
+uint64_t learnLogAppend(LearnLog *log, const wchar_t *modelName, const wchar_t *text, int count) {
+    char name[256], utf8text[LEARN_RECORD_MAX];
+    unsigned char record[LEARN_RECORD_MAX];
+
+    if (wcstombs(name, modelName, sizeof(name)) == (size_t)-1 ||
+        wcstombs(utf8text, text, sizeof(utf8text)) == (size_t)-1)
+        return 0;
+    name[sizeof(name) - 1] = '\0';
+    utf8text[sizeof(utf8text) - 1] = '\0';
+
+    size_t len = encodeLearnRecord(record, name, utf8text, (uint32_t)count);
+    if (len == 0) return 0;
+
+    pthread_mutex_lock(&log->lock);
+    if (log->failed) {
+        pthread_mutex_unlock(&log->lock);
+        return 0;
+    }
+    if (log->pendingLen + len > log->pendingCap) {
+        size_t cap = log->pendingCap ? log->pendingCap * 2 : 64 * 1024;
+        while (cap < log->pendingLen + len) cap *= 2;
+        char *grown = realloc(log->pending, cap);
+        if (!grown) {
+            pthread_mutex_unlock(&log->lock);
+            LOG(LOG_ERROR, L"Memory allocation failed, learned count not logged");
+            return 0;
+        }
+        log->pending = grown;
+        log->pendingCap = cap;
+    }
+    memcpy(log->pending + log->pendingLen, record, len);
+    log->pendingLen += len;
+    uint64_t sequence = ++log->appended;
+    pthread_mutex_unlock(&log->lock);
+    return sequence;
+}
+
+// Waits until the record with this sequence number is on disk. Returns 0
+// once it is, -1 if it never will be (no sequence, or a failed commit).
+int learnLogWait(LearnLog *log, uint64_t sequence) {
+    if (sequence == 0) return -1;
+    pthread_mutex_lock(&log->lock);
+    while (log->committed < sequence && !log->failed)
+        pthread_cond_wait(&log->committedChanged, &log->lock);
+    int durable = log->committed >= sequence;
+    pthread_mutex_unlock(&log->lock);
+    return durable ? 0 : -1;
+}
+
+// Starts a fresh log generation and hands the previous one, now
+// learned.log.old, to the compactor thread. Runs on the flusher, between
+// group commits; the rename and the new header are its only I/O. While an
+// old log is still unfolded (the compactor is busy, or its last fold failed)
+// no rotation happens and the fold is retried instead.
+void rotateLearnLog(LearnLog *log) {
+    pthread_mutex_lock(&log->lock);
+    int unfolded = log->foldGeneration != 0;
+    if (unfolded) {
+        log->foldRequested = 1;
+        pthread_cond_signal(&log->foldWake);
+    }
+    pthread_mutex_unlock(&log->lock);
+    if (unfolded) return;
+
+    close(log->fd);
+    if (rename(LEARN_LOG_FILE, LEARN_LOG_OLD_FILE) != 0) {
+        perror("Error rotating learned log");
+        log->fd = open(LEARN_LOG_FILE, O_WRONLY | O_APPEND);
+        return;
+    }
+
+    uint32_t rotated = log->generation++;
+    if (openLearnLogFile(log, 0) != 0) return;
+    pthread_mutex_lock(&log->lock);
+    log->foldGeneration = rotated;
+    log->foldRequested = 1;
+    pthread_cond_signal(&log->foldWake);
+    pthread_mutex_unlock(&log->lock);
+}
+
+// Compactor thread: folds learned.log.old into the base when the flusher
+// asks, so a long fold never holds up a group commit.
+void *learnLogCompactor(void *arg) {
+    LearnLog *log = arg;
+    while (1) {
+        pthread_mutex_lock(&log->lock);
+        while (!log->foldRequested) pthread_cond_wait(&log->foldWake, &log->lock);
+        log->foldRequested = 0;
+        uint32_t generation = log->foldGeneration;
+        pthread_mutex_unlock(&log->lock);
+        if (!generation) continue;
+
+        // On failure the old log stays in place; the next rotation retries it.
+        if (foldLogIntoBase(LEARN_LOG_OLD_FILE, generation) != 0) continue;
+        fprintf(stderr, "Learned log generation %u compacted\n", generation);
+        pthread_mutex_lock(&log->lock);
+        log->foldGeneration = 0;
+        pthread_mutex_unlock(&log->lock);
+    }
+    return NULL;
+}
+
+// Group commit: every LEARN_LOG_GROUP_COMMIT_MS all queued records are written
+// with one write() and one fdatasync(), then their waiters are released. Also
+// rotates the log for periodic compaction.
+void *learnLogFlusher(void *arg) {
+    LearnLog *log = arg;
+    char *batch = NULL;
+    size_t batchCap = 0;
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LEARN_LOG_GROUP_COMMIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&log->lock);
+        pthread_cond_timedwait(&log->wake, &log->lock, &deadline);
+        // Swap buffers so appenders are never blocked by disk I/O.
+        char *swap = log->pending;
+        size_t swapCap = log->pendingCap;
+        size_t batchLen = log->pendingLen;
+        uint64_t batchEnd = log->appended;
+        log->pending = batch;
+        log->pendingCap = batchCap;
+        log->pendingLen = 0;
+        batch = swap;
+        batchCap = swapCap;
+        pthread_mutex_unlock(&log->lock);
+
+        if (batchLen > 0) {
+            int written = log->fd >= 0 && writeFully(log->fd, batch, batchLen) == 0 && fdatasync(log->fd) == 0;
+            if (written)
+                log->size += batchLen;
+            else
+                perror("Error writing learned log, learned counts are no longer persisted");
+            pthread_mutex_lock(&log->lock);
+            if (written) log->committed = batchEnd;
+            else log->failed = 1;
+            pthread_cond_broadcast(&log->committedChanged);
+            pthread_mutex_unlock(&log->lock);
+        }
+
+        if (log->fd >= 0 && log->size > LEARN_LOG_HEADER_SIZE && log->size >= LEARN_LOG_COMPACT_MIN_BYTES &&
+            time(NULL) - log->lastCompaction >= LEARN_LOG_COMPACT_SECONDS) {
+            rotateLearnLog(log);
+            log->lastCompaction = time(NULL);
+        }
+    }
+    return NULL;
+}
+
+int learnLogStart(LearnLog *log) {
+    if (pthread_create(&log->compactor, NULL, learnLogCompactor, log) != 0) return -1;
+    return pthread_create(&log->flusher, NULL, learnLogFlusher, log);
+}
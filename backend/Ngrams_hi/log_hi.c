@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <wchar.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Logging for the request path.
+//
+// LOG(level, format, ...) costs one relaxed load when the level is off. When
+// it is on, the caller claims a slot in a fixed ring of records, copies the
+// format pointer and the argument values (strings by content) into it and
+// returns; nothing is formatted and no lock is taken. A background thread
+// formats the records and writes them to stderr in batches, one line each:
+//
+//   2026-10-19T10:15:02.481Z debug Suggestion[0]: भारत
+//
+// When the ring is full the record is dropped and counted instead of making
+// the request wait; the drain thread reports how many were lost.
+//
+// The format must be a string literal. Conversions: %d, %ld, %u, %zu (with
+// flags, width and precision digits), %ls, %s, and %%.
+//
+// The ring is a bounded multi-producer queue (Vyukov): every slot carries a
+// sequence number saying whether it is free for the producer at a given ring
+// position or holds a record for the reader. Sequences are kept relative to
+// the slot index so that the zero-initialized ring is ready without setup and
+// can be used before the drain thread starts.
+
+typedef enum { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG } LogLevel;
+
+#define LOG_RING_SIZE 1024                 // records, a power of two
+#define LOG_MAX_ARGS 6
+#define LOG_TEXT_LEN 192                   // characters of string arguments per record
+#define LOG_LINE_LEN 512
+#define LOG_DRAIN_INTERVAL_MS 20
+
+// Argument types as passed. Numbers are stored as unsigned long, strings as
+// an offset into the record's text.
+typedef enum { LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_UNSIGNED, LOG_ARG_UNSIGNED_LONG,
+               LOG_ARG_WIDE_TEXT, LOG_ARG_TEXT } LogArgType;
+
+typedef struct LogRecord {
+    unsigned long sequence;                // relative to the slot index, see above
+    int level;
+    struct timespec time;
+    const wchar_t *format;
+    int argCount;
+    struct {
+        LogArgType type;
+        unsigned long value;
+    } args[LOG_MAX_ARGS];
+    wchar_t text[LOG_TEXT_LEN];
+} LogRecord;
+
+typedef struct LogRing {
+    LogRecord records[LOG_RING_SIZE];
+    unsigned long head;                    // next position a producer claims
+    unsigned long tail;                    // next position the drain thread reads
+    unsigned long dropped;
+} LogRing;
+
+static const char *logLevelNames[] = { "error", "warn", "info", "debug" };
+int logLevel = LOG_INFO;
+static LogRing logRing;
+
+#define LOG(level, ...) do { \
+        if ((int)(level) <= __atomic_load_n(&logLevel, __ATOMIC_RELAXED)) logMessage((level), __VA_ARGS__); \
+    } while (0)
+
+// Level named name ("error", "warn", "info" or "debug"), or -1.
+int logLevelByName(const char *name) {
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++)
+        if (strcmp(name, logLevelNames[i]) == 0) return i;
+    return -1;
+}
+
+void logSetLevel(int level) {
+    __atomic_store_n(&logLevel, level, __ATOMIC_RELAXED);
+}
+
+// Reads the conversion starting after a '%' at p. Stores the type of its
+// argument and, when spec is not NULL, a swprintf specification for the
+// stored value (flags, width and precision kept). Returns the character after
+// it, or NULL for a conversion this logger does not take.
+static const wchar_t *logScanConversion(const wchar_t *p, LogArgType *type, wchar_t *spec, size_t specSize) {
+    const wchar_t *start = p;
+    while (*p && wcschr(L"-+ #0123456789.", *p)) p++;
+    size_t flags = p - start;
+    const wchar_t *suffix;
+
+    if (p[0] == L'd' || p[0] == L'i') { *type = LOG_ARG_INT; suffix = L"ld"; p += 1; }
+    else if (p[0] == L'l' && (p[1] == L'd' || p[1] == L'i')) { *type = LOG_ARG_LONG; suffix = L"ld"; p += 2; }
+    else if (p[0] == L'u') { *type = LOG_ARG_UNSIGNED; suffix = L"lu"; p += 1; }
+    else if ((p[0] == L'l' || p[0] == L'z') && p[1] == L'u') { *type = LOG_ARG_UNSIGNED_LONG; suffix = L"lu"; p += 2; }
+    else if (p[0] == L'l' && p[1] == L's') { *type = LOG_ARG_WIDE_TEXT; suffix = L"ls"; p += 2; }
+    else if (p[0] == L's') { *type = LOG_ARG_TEXT; suffix = L"ls"; p += 1; }
+    else return NULL;
+
+    if (spec) {
+        if (flags + 4 > specSize) flags = specSize - 4;
+        spec[0] = L'%';
+        wmemcpy(spec + 1, start, flags);
+        wcscpy(spec + 1 + flags, suffix);
+    }
+    return p;
+}
+
+// Copies a string argument into the record, truncated to the space left.
+static unsigned long logCopyText(LogRecord *record, size_t *used, const wchar_t *wide, const char *narrow) {
+    unsigned long offset = *used;
+    size_t room = LOG_TEXT_LEN - *used;
+    if (room == 0) return LOG_TEXT_LEN - 1;     // the final terminator: an empty string
+
+    size_t len;
+    if (!wide && !narrow) wide = L"(null)";
+    if (wide) {
+        len = wcslen(wide);
+        if (len > room - 1) len = room - 1;
+        wmemcpy(record->text + offset, wide, len);
+    } else {
+        len = 0;
+        mbstate_t state;
+        memset(&state, 0, sizeof(state));
+        const char *src = narrow;
+        size_t n = mbsrtowcs(record->text + offset, &src, room - 1, &state);
+        if (n != (size_t)-1) len = n;
+    }
+    record->text[offset + len] = L'\0';
+    *used += len + 1;
+    return offset;
+}
+
+void logMessage(int level, const wchar_t *format, ...) {
+    unsigned long pos = __atomic_load_n(&logRing.head, __ATOMIC_RELAXED);
+    LogRecord *record;
+    while (1) {
+        unsigned long index = pos & (LOG_RING_SIZE - 1);
+        record = &logRing.records[index];
+        long diff = (long)(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) + index - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&logRing.head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&logRing.dropped, 1, __ATOMIC_RELAXED);   // full
+            return;
+        } else {
+            pos = __atomic_load_n(&logRing.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->level = level;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->format = format;
+    record->argCount = 0;
+    record->text[LOG_TEXT_LEN - 1] = L'\0';
+
+    va_list args;
+    va_start(args, format);
+    size_t used = 0;
+    for (const wchar_t *p = format; *p && record->argCount < LOG_MAX_ARGS; p++) {
+        if (*p != L'%') continue;
+        if (p[1] == L'%') {
+            p++;
+            continue;
+        }
+        LogArgType type;
+        const wchar_t *next = logScanConversion(p + 1, &type, NULL, 0);
+        if (!next) break;
+        unsigned long value;
+        switch (type) {
+        case LOG_ARG_INT:           value = (unsigned long)(long)va_arg(args, int); break;
+        case LOG_ARG_LONG:          value = (unsigned long)va_arg(args, long); break;
+        case LOG_ARG_UNSIGNED:      value = va_arg(args, unsigned); break;
+        case LOG_ARG_UNSIGNED_LONG: value = va_arg(args, unsigned long); break;
+        case LOG_ARG_WIDE_TEXT:     value = logCopyText(record, &used, va_arg(args, const wchar_t *), NULL); break;
+        default:                    value = logCopyText(record, &used, NULL, va_arg(args, const char *)); break;
+        }
+        record->args[record->argCount].type = type;
+        record->args[record->argCount].value = value;
+        record->argCount++;
+        p = next - 1;
+    }
+    va_end(args);
+
+    unsigned long index = pos & (LOG_RING_SIZE - 1);
+    __atomic_store_n(&record->sequence, pos + 1 - index, __ATOMIC_RELEASE);
+}
+
+// Formats one record into line.
+static void logFormat(LogRecord *record, wchar_t *line, size_t size) {
+    struct tm tm;
+    gmtime_r(&record->time.tv_sec, &tm);
+    int len = swprintf(line, size, L"%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ %s ",
+                       tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                       record->time.tv_nsec / 1000000, logLevelNames[record->level]);
+    if (len < 0) len = 0;
+
+    int arg = 0;
+    for (const wchar_t *p = record->format; *p && (size_t)len + 1 < size; p++) {
+        if (*p != L'%') {
+            line[len++] = *p;
+            continue;
+        }
+        if (p[1] == L'%') {
+            line[len++] = L'%';
+            p++;
+            continue;
+        }
+        wchar_t spec[16];
+        LogArgType type;
+        const wchar_t *next = logScanConversion(p + 1, &type, spec, 16);
+        if (!next || arg >= record->argCount) break;
+
+        int n;
+        unsigned long value = record->args[arg++].value;
+        if (type == LOG_ARG_WIDE_TEXT || type == LOG_ARG_TEXT)
+            n = swprintf(line + len, size - len, spec, record->text + value);
+        else if (type == LOG_ARG_INT || type == LOG_ARG_LONG)
+            n = swprintf(line + len, size - len, spec, (long)value);
+        else
+            n = swprintf(line + len, size - len, spec, value);
+        if (n < 0) break;            // truncated
+        len += n;
+        p = next - 1;
+    }
+    if ((size_t)len > size - 2) len = size - 2;
+    line[len++] = L'\n';
+    line[len] = L'\0';
+}
+
+static void logWriteAll(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, data, len);
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+// Drain thread: formats and writes every published record, then sleeps
+// LOG_DRAIN_INTERVAL_MS when the ring is empty.
+static void *logDrain(void *arg) {
+    (void)arg;
+    char batch[16384];
+    size_t batchLen = 0;
+    unsigned long reportedDrops = 0;
+    wchar_t line[LOG_LINE_LEN];
+    char utf8[LOG_LINE_LEN * 4];
+
+    while (1) {
+        unsigned long tail = logRing.tail;
+        unsigned long index = tail & (LOG_RING_SIZE - 1);
+        LogRecord *record = &logRing.records[index];
+
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) + index == tail + 1) {
+            logFormat(record, line, LOG_LINE_LEN);
+            __atomic_store_n(&record->sequence, tail + LOG_RING_SIZE - index, __ATOMIC_RELEASE);
+            logRing.tail = tail + 1;
+
+            size_t n = wcstombs(utf8, line, sizeof(utf8));
+            if (n == (size_t)-1) continue;
+            if (batchLen + n > sizeof(batch)) {
+                logWriteAll(batch, batchLen);
+                batchLen = 0;
+            }
+            memcpy(batch + batchLen, utf8, n);
+            batchLen += n;
+            continue;
+        }
+
+        unsigned long dropped = __atomic_load_n(&logRing.dropped, __ATOMIC_RELAXED);
+        if (dropped != reportedDrops) {
+            int n = snprintf(batch + batchLen, sizeof(batch) - batchLen, "log: %lu records dropped, ring full\n",
+                             dropped - reportedDrops);
+            if (n > 0 && (size_t)n < sizeof(batch) - batchLen) batchLen += n;
+            reportedDrops = dropped;
+        }
+        if (batchLen > 0) {
+            logWriteAll(batch, batchLen);
+            batchLen = 0;
+        }
+        struct timespec pause = { 0, LOG_DRAIN_INTERVAL_MS * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// Starts the drain thread. Records logged before are kept, up to the ring size.
+int logStart(void) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, logDrain, NULL) != 0) {
+        perror("Cannot start log thread");
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// Batched trie lookups.
+//
+// A lookup walks one node per character, and each step loads a child pointer
+// from a node that was itself just loaded: a chain of cache misses with
+// nothing to overlap. The batch versions below keep LOOKUP_BATCH_GROUP keys
+// in flight and advance them in turn, one character per visit, prefetching
+// the child slot a key reads next as soon as its node is known. By the time
+// the round comes back to that key, the load has had the rest of the group to
+// arrive, so the misses of the whole group overlap. A key that finishes hands
+// its slot to the next key of the batch at once, so the group stays full
+// whatever the key lengths.
+//
+// Results are the same as the single lookups: searchPrefix, searchDict and
+// traverseContext.
+
+#define LOOKUP_BATCH_GROUP 16
+
+// The child index of ch in the dictionary trie, -1 if it has none.
+static int dictChildIndex(wchar_t ch) {
+    int offset = ch - UNICODE_BASE;
+    return offset >= 0 && offset < MAX_CHILDREN ? offset : -1;
+}
+
+// The child index of ch in the n-gram trie (0 for the space), -1 if none.
+static int ngramChildIndex(wchar_t ch) {
+    if (ch == L' ') return 0;
+    int index = (ch - UNICODE_BASE) + 1;
+    return index > 0 && index <= MAX_DEVA_CHARS ? index : -1;
+}
+
+// One key in flight: the node reached, the rest of the key and the child
+// index to take on the next visit (negative before the first).
+typedef struct LookupSlot {
+    const wchar_t *cursor;
+    void *node;
+    int next;
+    int key;               // index into the batch, for the result
+} LookupSlot;
+
+// Walks keys[0..count) down a trie whose nodes start with their children
+// array. indexOf maps a character to its child index or -1; characters it
+// rejects end the walk with NULL, or are skipped when skipUnknown is set.
+// Inlined into each caller, so indexOf is a direct call.
+static inline __attribute__((always_inline)) void lookupBatch(void *root, const wchar_t **keys, int count, void **results,
+                                                      int (*indexOf)(wchar_t), int skipUnknown) {
+    LookupSlot slots[LOOKUP_BATCH_GROUP];
+    int active = 0, fed = 0;
+
+    while (active > 0 || fed < count) {
+        // Fill free slots with the next keys.
+        while (active < LOOKUP_BATCH_GROUP && fed < count) {
+            LookupSlot *slot = &slots[active++];
+            slot->cursor = keys[fed];
+            slot->node = root;
+            slot->key = fed++;
+            slot->next = -1;
+        }
+
+        for (int i = 0; i < active; ) {
+            LookupSlot *slot = &slots[i];
+            // Take the child chosen on the previous visit, whose slot was prefetched.
+            if (slot->next >= 0) {
+                slot->node = ((void **)slot->node)[slot->next];
+                slot->cursor++;
+            }
+            // Find the next child index, skipping or failing on foreign characters.
+            int next = -1;
+            while (slot->node && *slot->cursor) {
+                next = indexOf(*slot->cursor);
+                if (next >= 0) break;
+                if (!skipUnknown) slot->node = NULL;
+                else slot->cursor++;
+            }
+            if (!slot->node || !*slot->cursor) {
+                results[slot->key] = slot->node;
+                *slot = slots[--active];      // the slot goes to a waiting key
+                continue;
+            }
+            slot->next = next;
+            __builtin_prefetch(&((void **)slot->node)[next]);
+            i++;
+        }
+    }
+}
+
+// searchPrefix for each of keys[0..count).
+void searchPrefixBatch(TrieNode *root, const wchar_t **keys, int count, TrieNode **results) {
+    lookupBatch(root, keys, count, (void **)results, dictChildIndex, 0);
+}
+
+// searchDict for each of words[0..count): found[i] is 1 for a dictionary
+// word or a word with a count.
+void searchDictBatch(TrieNode *root, const wchar_t **words, int count, int *found) {
+    TrieNode *nodes[LOOKUP_BATCH_GROUP * 4];
+    for (int base = 0; base < count; base += LOOKUP_BATCH_GROUP * 4) {
+        int size = count - base < LOOKUP_BATCH_GROUP * 4 ? count - base : LOOKUP_BATCH_GROUP * 4;
+        lookupBatch(root, words + base, size, (void **)nodes, dictChildIndex, 1);
+        for (int i = 0; i < size; i++)
+            found[base + i] = nodes[i] && (nodes[i]->isWord || nodes[i]->frequency > 0);
+    }
+}
+
+// traverseContext for each of contexts[0..count).
+void traverseContextBatch(ngramTrieNode *root, const wchar_t **contexts, int count, ngramTrieNode **results) {
+    lookupBatch(root, contexts, count, (void **)results, ngramChildIndex, 1);
+}
@@ -5,8 +5,6 @@
 
 void sk(int cnt, wchar_t *temp, FILE *grams[], wint_t ch)
 {
-    setlocale(LC_ALL, "");
-
     // Valid cnt values: 1 to 4 (i.e., 2-gram to 5-gram)
     if (cnt >= 1 && cnt <= 4)
     {
@@ -18,11 +16,10 @@ void sk(int cnt, wchar_t *temp, FILE *grams[], wint_t ch)
     temp[0] = L'\0';
 }
 
-void grams()
+void grams(const char *prefix)
 {
-    setlocale(LC_ALL, "");
-
     FILE *grams[5];
+    char path[256];
     wchar_t *temp;
     int ch, cnt = 0, cap = 0, size = 32;
 
@@ -30,11 +27,12 @@ void grams()
     temp = malloc(size * sizeof(wchar_t));
 
     // Open files
-    grams[0] = fopen("2grms.txt", "w");
-    grams[1] = fopen("3grms.txt", "w");
-    grams[2] = fopen("4grms.txt", "w");
-    grams[3] = fopen("5grms.txt", "w");
-    grams[4] = fopen("ngrams.txt", "r");
+    for (int n = 2; n <= 5; n++) {
+        snprintf(path, sizeof(path), "%s%dgrms.txt", prefix, n);
+        grams[n - 2] = fopen(path, "w");
+    }
+    snprintf(path, sizeof(path), "%sngrams.txt", prefix);
+    grams[4] = fopen(path, "r");
 
     if (!temp || !grams[4]) {
         fwprintf(stderr, L"File open or memory error.\n");
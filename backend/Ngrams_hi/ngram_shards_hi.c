@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// N-gram tables: one order of one model.
+//
+// Bigrams and trigrams are held as one trie. The 4- and 5-gram tables are the
+// largest and the least used, so they are written to disk split into
+// NGRAM_SHARD_COUNT shards by a hash of the first word, and a shard is built
+// into a trie only when a request first needs it. Every n-gram a request can
+// touch in a table (context, context + partial word, learned n-gram) starts
+// with the same first word, so each lookup needs exactly one shard.
+//
+// Resident shards are shared by all sharded tables under one memory budget.
+// Loading a shard that takes the total over the budget evicts the least
+// recently used shards that no request is using.
+//
+// N-grams of corpus files ingested after the shard file was written ("!ingest")
+// and learned counts are kept per shard as extra lines in memory, applied to
+// the shard if it is resident and replayed each time it is loaded again, so
+// neither rewrites the shard file and a shard holding them can be evicted like
+// any other. The lines stay in memory and count against the budget, as does
+// what learning and ingesting add to a resident trie.
+//
+// Shard file layout (host byte order):
+//   header: uint32 magic, uint32 shardCount, shardCount * (uint64 offset, uint64 length)
+//   shards: the n-gram lines of each shard, UTF-8, one occurrence per line
+
+#define NGRAM_SHARD_MAGIC 0x4853474eu          // "NGSH"
+#define NGRAM_SHARD_COUNT 64
+#define NGRAM_SHARD_WRITE_BUFFER (64 * 1024)
+#define DEFAULT_NGRAM_MEMORY_MB 256
+
+typedef struct NgramShard {
+    ngramTrieNode *root;        // NULL while on disk
+    size_t bytes;               // memory held by root
+    unsigned long lastUsed;     // cache clock at the last acquire
+    int users;                  // requests walking root right now
+    int loading;
+    char *ingested;             // lines ingested since the shard file was written
+    size_t ingestedLen, ingestedCap;
+    char *learned;              // learned counts, "<delta> <n-gram>" lines
+    size_t learnedLen, learnedCap;
+    uint64_t offset, length;    // location in the shard file
+} NgramShard;
+
+typedef struct NgramShardCache {
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+    size_t residentBytes, budgetBytes;
+    size_t lineBytes;           // of residentBytes, held by ingested and learned lines
+    unsigned long clock;
+    struct NgramTable *tables;  // every sharded table, for eviction
+} NgramShardCache;
+
+typedef struct NgramTable {
+    ngramTrieNode *root;        // whole trie, for tables held in memory
+    int fd;                     // sharded tables: open shard file
+    char path[256];
+    NgramShard shards[NGRAM_SHARD_COUNT];
+    NgramShardCache *cache;
+    struct NgramTable *next;    // in cache->tables
+} NgramTable;
+
+NgramShardCache ngramShardCache = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0,
+    (size_t)DEFAULT_NGRAM_MEMORY_MB * 1024 * 1024, 0, 0, NULL
+};
+
+// Shard of an n-gram: a hash of the Devanagari letters of its first word,
+// the characters the trie itself keeps.
+int ngramShardOf(const wchar_t *ngram) {
+    return firstWordHash(ngram) % NGRAM_SHARD_COUNT;
+}
+
+// Memory held by one node, counting the continuation list of a context node
+// at an average word length.
+size_t ngramNodeBytes(ngramTrieNode *node) {
+    size_t bytes = sizeof(ngramTrieNode);
+    if (node->context)
+        bytes += sizeof(NgramContext) + sizeof(NgramTopList) + NGRAM_TOP_K * 16 * sizeof(wchar_t);
+    return bytes;
+}
+
+size_t ngramTrieBytes(ngramTrieNode *node) {
+    size_t bytes = ngramNodeBytes(node);
+    for (int i = 0; i <= MAX_DEVA_CHARS; i++)
+        if (node->children[i]) bytes += ngramTrieBytes(node->children[i]);
+    return bytes;
+}
+
+int pwriteFully(int fd, const char *data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Splits the n-gram file gramsPath into the shard file shardPath. Two passes
+// over the input, so memory use does not grow with the corpus. Returns 0 on
+// success.
+int writeShardedTable(const char *gramsPath, const char *shardPath) {
+    FILE *in = fopen(gramsPath, "r");
+    if (!in) {
+        perror("Error opening ngram file");
+        return -1;
+    }
+
+    uint64_t lengths[NGRAM_SHARD_COUNT] = { 0 }, cursor[NGRAM_SHARD_COUNT];
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    wchar_t wline[MAX_NGRAM_LEN];
+
+    // Pass 1: size of every shard.
+    while ((len = getline(&line, &cap, in)) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || mbstowcs(wline, line, MAX_NGRAM_LEN - 1) == (size_t)-1) continue;
+        wline[MAX_NGRAM_LEN - 1] = L'\0';
+        lengths[ngramShardOf(wline)] += strlen(line) + 1;
+    }
+
+    uint32_t header[2] = { NGRAM_SHARD_MAGIC, NGRAM_SHARD_COUNT };
+    uint64_t index[NGRAM_SHARD_COUNT * 2];
+    uint64_t offset = sizeof(header) + sizeof(index);
+    for (int s = 0; s < NGRAM_SHARD_COUNT; s++) {
+        index[2 * s] = cursor[s] = offset;
+        index[2 * s + 1] = lengths[s];
+        offset += lengths[s];
+    }
+
+    int fd = open(shardPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    char *buffers = malloc((size_t)NGRAM_SHARD_COUNT * NGRAM_SHARD_WRITE_BUFFER);
+    size_t used[NGRAM_SHARD_COUNT] = { 0 };
+    int failed = fd < 0 || !buffers ||
+                 pwriteFully(fd, (char *)header, sizeof(header), 0) != 0 ||
+                 pwriteFully(fd, (char *)index, sizeof(index), sizeof(header)) != 0;
+
+    // Pass 2: each line goes to its shard's buffer, written out when full.
+    rewind(in);
+    while (!failed && (len = getline(&line, &cap, in)) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || mbstowcs(wline, line, MAX_NGRAM_LEN - 1) == (size_t)-1) continue;
+        wline[MAX_NGRAM_LEN - 1] = L'\0';
+        int s = ngramShardOf(wline);
+        size_t n = strlen(line) + 1;
+        char *buffer = buffers + (size_t)s * NGRAM_SHARD_WRITE_BUFFER;
+
+        if (used[s] + n > NGRAM_SHARD_WRITE_BUFFER) {
+            failed = pwriteFully(fd, buffer, used[s], cursor[s]) != 0;
+            cursor[s] += used[s];
+            used[s] = 0;
+        }
+        if (n > NGRAM_SHARD_WRITE_BUFFER) {   // longer than a buffer: write directly
+            line[n - 1] = '\n';
+            failed = failed || pwriteFully(fd, line, n, cursor[s]) != 0;
+            cursor[s] += n;
+            continue;
+        }
+        memcpy(buffer + used[s], line, n - 1);
+        buffer[used[s] + n - 1] = '\n';
+        used[s] += n;
+    }
+    for (int s = 0; s < NGRAM_SHARD_COUNT && !failed; s++)
+        failed = pwriteFully(fd, buffers + (size_t)s * NGRAM_SHARD_WRITE_BUFFER, used[s], cursor[s]) != 0;
+
+    if (failed) fprintf(stderr, "Cannot write shard file %s: %s\n", shardPath, strerror(errno));
+    if (fd >= 0) close(fd);
+    free(buffers);
+    free(line);
+    fclose(in);
+    return failed ? -1 : 0;
+}
+
+NgramTable *createMemoryTable(ngramTrieNode *root) {
+    NgramTable *table = calloc(1, sizeof(NgramTable));
+    if (!table) {
+        fprintf(stderr, "Out of memory for n-gram table\n");
+        exit(1);
+    }
+    table->root = root;
+    table->fd = -1;
+    return table;
+}
+
+// Opens a shard file written by writeShardedTable. Nothing is loaded yet.
+NgramTable *openShardedTable(const char *shardPath, NgramShardCache *cache) {
+    uint32_t header[2];
+    uint64_t index[NGRAM_SHARD_COUNT * 2];
+    int fd = open(shardPath, O_RDONLY);
+    if (fd < 0 || pread(fd, header, sizeof(header), 0) != sizeof(header) ||
+        header[0] != NGRAM_SHARD_MAGIC || header[1] != NGRAM_SHARD_COUNT ||
+        pread(fd, index, sizeof(index), sizeof(header)) != sizeof(index)) {
+        fprintf(stderr, "Invalid shard file %s\n", shardPath);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    NgramTable *table = createMemoryTable(NULL);
+    table->fd = fd;
+    snprintf(table->path, sizeof(table->path), "%s", shardPath);
+    table->cache = cache;
+    for (int s = 0; s < NGRAM_SHARD_COUNT; s++) {
+        table->shards[s].offset = index[2 * s];
+        table->shards[s].length = index[2 * s + 1];
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    table->next = cache->tables;
+    cache->tables = table;
+    pthread_mutex_unlock(&cache->lock);
+    return table;
+}
+
+// Inserts the n-gram lines of data (modified in place) into root.
+void insertShardLines(ngramTrieNode *root, char *data) {
+    wchar_t line[MAX_NGRAM_LEN];
+    char *state = NULL;
+    for (char *text = strtok_r(data, "\n", &state); text; text = strtok_r(NULL, "\n", &state)) {
+        if (mbstowcs(line, text, MAX_NGRAM_LEN - 1) == (size_t)-1) continue;
+        line[MAX_NGRAM_LEN - 1] = L'\0';
+        normalizeDevanagari(line, line, MAX_NGRAM_LEN);
+        if (wcslen(line) > 0 && wcscspn(line, L"\x00-\x08\x0B\x0C\x0E-\x1F") == wcslen(line))
+            insertNgram(root, line);
+    }
+}
+
+// Applies the "<delta> <n-gram>" lines of data (modified in place) to root.
+void learnShardLines(ngramTrieNode *root, char *data) {
+    wchar_t line[MAX_NGRAM_LEN];
+    char *state = NULL;
+    for (char *text = strtok_r(data, "\n", &state); text; text = strtok_r(NULL, "\n", &state)) {
+        char *ngram;
+        long delta = strtol(text, &ngram, 10);
+        if (ngram == text || *ngram != ' ' || mbstowcs(line, ngram + 1, MAX_NGRAM_LEN - 1) == (size_t)-1) continue;
+        line[MAX_NGRAM_LEN - 1] = L'\0';
+        learnNgram(root, line, (int)delta);
+    }
+}
+
+// Builds the trie of one shard from its lines in the shard file and the
+// lines ingested since, then applies its learned counts. Ingesting and
+// learning wait while a shard loads, so the lines do not change under it.
+ngramTrieNode *loadNgramShard(NgramTable *table, NgramShard *shard) {
+    ngramTrieNode *root = createNgramNode();
+    char *data = malloc(shard->length + shard->ingestedLen + 1);
+    if (!data || pread(table->fd, data, shard->length, shard->offset) != (ssize_t)shard->length) {
+        fprintf(stderr, "Cannot read shard of %s\n", table->path);
+        free(data);
+        return root;
+    }
+    if (shard->ingestedLen) memcpy(data + shard->length, shard->ingested, shard->ingestedLen);
+    data[shard->length + shard->ingestedLen] = '\0';
+
+    insertShardLines(root, data);
+    free(data);
+    buildContinuationLists(root);
+
+    if (shard->learnedLen) {
+        char *learned = malloc(shard->learnedLen + 1);
+        if (!learned) {
+            fprintf(stderr, "Out of memory for the learned counts of %s\n", table->path);
+            return root;
+        }
+        memcpy(learned, shard->learned, shard->learnedLen);
+        learned[shard->learnedLen] = '\0';
+        learnShardLines(root, learned);
+        free(learned);
+    }
+    return root;
+}
+
+// Frees least recently used shards until the cache fits its budget. Shards
+// in use or loading stay. Called with the lock held.
+void evictNgramShards(NgramShardCache *cache) {
+    while (cache->residentBytes > cache->budgetBytes) {
+        NgramShard *victim = NULL;
+        for (NgramTable *table = cache->tables; table; table = table->next) {
+            for (int s = 0; s < NGRAM_SHARD_COUNT; s++) {
+                NgramShard *shard = &table->shards[s];
+                if (!shard->root || shard->users || shard->loading) continue;
+                if (!victim || shard->lastUsed < victim->lastUsed) victim = shard;
+            }
+        }
+        if (!victim) return;
+
+        freeNgramTrie(victim->root);
+        victim->root = NULL;
+        cache->residentBytes -= victim->bytes;
+        victim->bytes = 0;
+    }
+}
+
+// The trie of shard s of a sharded table, loaded if needed (or NULL when it
+// is not resident and load is 0). A returned trie stays valid until the
+// matching releaseNgramTable.
+ngramTrieNode *acquireNgramShard(NgramTable *table, int s, int load) {
+    NgramShardCache *cache = table->cache;
+    NgramShard *entry = &table->shards[s];
+
+    pthread_mutex_lock(&cache->lock);
+    while (entry->loading)
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    if (!entry->root && !load) {
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    entry->users++;
+    entry->lastUsed = ++cache->clock;
+
+    if (!entry->root) {
+        entry->loading = 1;
+        pthread_mutex_unlock(&cache->lock);
+        ngramTrieNode *root = loadNgramShard(table, entry);
+        size_t bytes = ngramTrieBytes(root);
+        pthread_mutex_lock(&cache->lock);
+
+        entry->root = root;
+        entry->bytes = bytes;
+        entry->loading = 0;
+        cache->residentBytes += bytes;
+        evictNgramShards(cache);
+        pthread_cond_broadcast(&cache->loaded);
+    }
+    ngramTrieNode *root = entry->root;
+    pthread_mutex_unlock(&cache->lock);
+    return root;
+}
+
+// The trie holding ngram (or any n-gram starting with its first word),
+// loading it if needed. The returned trie stays valid until the matching
+// releaseNgramTable; *shard receives what to pass it. NULL if table is NULL.
+ngramTrieNode *acquireNgramTable(NgramTable *table, const wchar_t *ngram, int *shard) {
+    *shard = -1;
+    if (!table) return NULL;
+    if (table->fd < 0) return table->root;
+
+    int s = ngramShardOf(ngram);
+    *shard = s;
+    return acquireNgramShard(table, s, 1);
+}
+
+void releaseNgramTable(NgramTable *table, int shard) {
+    if (!table || shard < 0) return;
+    pthread_mutex_lock(&table->cache->lock);
+    table->shards[shard].users--;
+    pthread_mutex_unlock(&table->cache->lock);
+}
+
+// Appends len bytes of text to one of a shard's line buffers, charging the
+// buffer's growth to the cache. Called with the lock held; -1 when out of
+// memory.
+int appendShardLine(NgramShardCache *cache, char **buffer, size_t *used, size_t *capacity,
+                    const char *text, size_t len) {
+    if (*used + len > *capacity) {
+        size_t cap = *capacity ? *capacity * 2 : 4096;
+        while (cap < *used + len) cap *= 2;
+        char *grown = realloc(*buffer, cap);
+        if (!grown) return -1;
+        cache->residentBytes += cap - *capacity;
+        cache->lineBytes += cap - *capacity;
+        *buffer = grown;
+        *capacity = cap;
+    }
+    memcpy(*buffer + *used, text, len);
+    *used += len;
+    return 0;
+}
+
+// Records delta occurrences of ngram in its shard: as an ingested line
+// (delta 1) or a learned one, and in the shard's trie if it is resident.
+// Returns -1 when out of memory.
+int addShardNgram(NgramTable *table, const wchar_t *ngram, int delta, int learned) {
+    char text[MAX_NGRAM_LEN * 4 + 16];
+    int prefix = learned ? snprintf(text, sizeof(text), "%d ", delta) : 0;
+    size_t len = wcstombs(text + prefix, ngram, sizeof(text) - prefix - 1);
+    if (len == (size_t)-1 || len == 0) return 0;
+    len += prefix;
+    text[len++] = '\n';
+
+    NgramShardCache *cache = table->cache;
+    int s = ngramShardOf(ngram);
+    NgramShard *shard = &table->shards[s];
+    pthread_mutex_lock(&cache->lock);
+    while (shard->loading)
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    int failed = learned ? appendShardLine(cache, &shard->learned, &shard->learnedLen, &shard->learnedCap, text, len)
+                         : appendShardLine(cache, &shard->ingested, &shard->ingestedLen, &shard->ingestedCap, text, len);
+    ngramTrieNode *root = failed ? NULL : shard->root;
+    if (root) shard->users++;
+    pthread_mutex_unlock(&cache->lock);
+    if (failed) return -1;
+    if (!root) return 0;   // applied when the shard is next loaded
+
+    size_t added = (size_t)learnNgram(root, ngram, delta) * sizeof(ngramTrieNode);
+    pthread_mutex_lock(&cache->lock);
+    shard->users--;
+    shard->bytes += added;
+    cache->residentBytes += added;
+    evictNgramShards(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+// learnNgram on the table, or on the right shard if it is sharded. A shard
+// that is not resident stays on disk and gets the count when it is loaded.
+void learnNgramTable(NgramTable *table, const wchar_t *ngram, int delta) {
+    if (!table) return;
+    if (table->fd < 0) learnNgram(table->root, ngram, delta);
+    else if (addShardNgram(table, ngram, delta, 1) != 0)
+        fprintf(stderr, "Out of memory for learned counts of %s\n", table->path);
+}
+
+// Adds one occurrence of an n-gram from a newly ingested corpus file: to the
+// trie of a table held in memory, or to the lines of its shard, and to the
+// shard's trie if it is resident. Returns -1 when out of memory.
+int ingestNgramTable(NgramTable *table, const wchar_t *ngram) {
+    if (table->fd < 0) {
+        learnNgram(table->root, ngram, 1);
+        return 0;
+    }
+    return addShardNgram(table, ngram, 1, 0);
+}
+
+// "n-gram shards: ..." line of "!status": memory held against the budget and
+// how much of it are ingested and learned lines, which cannot be evicted.
+void writeNgramMemory(NgramShardCache *cache, FILE *out) {
+    pthread_mutex_lock(&cache->lock);
+    fprintf(out, "n-gram shards: %.1f MB of %.1f MB, %.1f MB of it ingested and learned lines\n",
+            cache->residentBytes / 1048576.0, cache->budgetBytes / 1048576.0, cache->lineBytes / 1048576.0);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Counts the shards of table in memory, for status reports.
+int residentNgramShards(NgramTable *table) {
+    int count = 0;
+    if (!table || table->fd < 0) return table ? NGRAM_SHARD_COUNT : 0;
+    pthread_mutex_lock(&table->cache->lock);
+    for (int s = 0; s < NGRAM_SHARD_COUNT; s++)
+        if (table->shards[s].root) count++;
+    pthread_mutex_unlock(&table->cache->lock);
+    return count;
+}
+
+void freeNgramTable(NgramTable *table) {
+    if (!table) return;
+    if (table->root) freeNgramTrie(table->root);
+    for (int s = 0; s < NGRAM_SHARD_COUNT; s++) {
+        if (table->shards[s].root) freeNgramTrie(table->shards[s].root);
+        free(table->shards[s].ingested);
+        free(table->shards[s].learned);
+    }
+    if (table->fd >= 0) close(table->fd);
+    free(table);
+}
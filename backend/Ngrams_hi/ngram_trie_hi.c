@@ -3,17 +3,22 @@
 #include <string.h>
 #include <wchar.h>
 #include <locale.h>
+#include <pthread.h>
 
 #define UNICODE_BASE 0x0900      // Start of Devanagari block
 #define MAX_DEVA_CHARS 128        
 #define MAX_NGRAM_LEN 512
 #define MAX_RESULTS 20
 #define MAX_PHRASE_LEN 100
+#define NGRAM_TOP_K 16            // continuations kept per context, enough for the widest beam
+
+struct NgramContext;
 
 typedef struct ngramTrieNode {
     struct ngramTrieNode *children[MAX_DEVA_CHARS + 1];  //1 for space character
     int isEndOfWord;
     int frequency;
+    struct NgramContext *context;   // set on nodes reached by "context ", see below
 } ngramTrieNode;
 
 typedef struct {
@@ -25,31 +30,6 @@ int compareSuggestions(const void *a, const void *b) {
     return ((Suggestion *)b)->frequency - ((Suggestion *)a)->frequency;
 }
 
-void collectSuggestions(ngramTrieNode *node, wchar_t *buffer, int depth,Suggestion *suggestions, int *count) {
-    if (!node || *count >= MAX_RESULTS) return;
-
-    if (node->isEndOfWord) {
-        buffer[depth] = L'\0';
-        wcscpy(suggestions[*count].phrase, buffer);
-        suggestions[*count].frequency = node->frequency;
-        (*count)++;
-    }
-
-    for (int i = 0; i <= MAX_DEVA_CHARS; i++) {
-        if (node->children[i]) {
-            if (i == 0){
-    		buffer[depth] = L' ';
-	    }
-	    else{
-	    	wchar_t ch = (wchar_t)(UNICODE_BASE + i - 1);
-            	if (ch < 0x0900 || ch > 0x097F) continue; // Skip invalid Unicode
-            	buffer[depth] = ch;
-	    }
-	    collectSuggestions(node->children[i], buffer, depth + 1, suggestions, count);
-        }
-    }
-}
-
 ngramTrieNode* traverseContext(ngramTrieNode *root, wchar_t *context) {
     ngramTrieNode *node = root;
 
@@ -74,33 +54,337 @@ ngramTrieNode* traverseContext(ngramTrieNode *root, wchar_t *context) {
 }
 
 
+// Inserts phrase into the frequency-sorted array top (at most limit entries).
+void insertTopSuggestion(Suggestion *top, int *count, int limit, const wchar_t *phrase, int frequency) {
+    if (*count == limit && top[limit - 1].frequency >= frequency) return;
+
+    int i = (*count < limit) ? (*count)++ : limit - 1;
+    while (i > 0 && top[i - 1].frequency < frequency) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    wcsncpy(top[i].phrase, phrase, MAX_PHRASE_LEN - 1);
+    top[i].phrase[MAX_PHRASE_LEN - 1] = L'\0';
+    top[i].frequency = frequency;
+}
+
+// Walks the single-word continuations below node, which is reached by
+// "context " or "context partialword" (buffer[0..depth) holds the word so
+// far). Keeps the limit most frequent in top and returns the summed count of
+// every continuation, the denominator of the next-word probability.
+long collectNextWords(ngramTrieNode *node, wchar_t *buffer, int depth, Suggestion *top, int *count,
+                      int limit, RequestBudget *budget) {
+    if (!node || depth >= MAX_PHRASE_LEN - 1 || budgetExpired(budget)) return 0;
+
+    long total = 0;
+    if (node->isEndOfWord && depth > 0) {
+        buffer[depth] = L'\0';
+        total += node->frequency;
+        insertTopSuggestion(top, count, limit, buffer, node->frequency);
+    }
+
+    // Index 0 is the space: the word ends there, so it is not followed.
+    for (int i = 1; i <= MAX_DEVA_CHARS; i++) {
+        if (node->children[i]) {
+            buffer[depth] = (wchar_t)(UNICODE_BASE + i - 1);
+            total += collectNextWords(node->children[i], buffer, depth + 1, top, count, limit, budget);
+        }
+    }
+    return total;
+}
+
+// Completes the partially typed word prefix after context (whole words,
+// space separated) from the continuations stored under "context prefix".
+// The walk never leaves that subtree, so it costs about one prefix lookup.
+// Fills top with up to limit whole words, most frequent first.
+int searchContextCompletions(ngramTrieNode *root, const wchar_t *context, const wchar_t *prefix,
+                             Suggestion *top, int limit, RequestBudget *budget) {
+    wchar_t path[MAX_NGRAM_LEN];
+    size_t prefixLen = wcslen(prefix);
+    if (prefixLen == 0 || prefixLen >= MAX_PHRASE_LEN - 1) return 0;
+
+    swprintf(path, MAX_NGRAM_LEN, L"%ls %ls", context, prefix);
+    ngramTrieNode *node = traverseContext(root, path);
+    if (!node) return 0;
+
+    wchar_t buffer[MAX_PHRASE_LEN];
+    wcscpy(buffer, prefix);
+    int count = 0;
+    collectNextWords(node, buffer, prefixLen, top, &count, limit, budget);
+    return count;
+}
+
+// Precomputed continuations.
+//
+// Every node reached by "context " (a space after whole words) that has
+// continuations carries an NgramContext: the summed count of all its
+// continuations and a list of the NGRAM_TOP_K most frequent ones, filled in
+// by buildContinuationLists once the trie is loaded. A next-word query is then
+// one traversal of the context and a copy of the list.
+//
+// Lists are immutable once published. Entries point at the n-gram's end node,
+// so counts are read live and learning only publishes a new list when a word
+// outside it overtakes the weakest entry. Replaced lists may still be read by
+// concurrent queries and are freed once none can be (see retireTopList).
+
+typedef struct NgramTopEntry {
+    ngramTrieNode *node;       // end node of "context word"
+    const wchar_t *word;       // points into the owning list's text
+} NgramTopEntry;
+
+typedef struct NgramTopList {
+    int count;
+    NgramTopEntry entries[NGRAM_TOP_K];
+    struct NgramTopList *retired;   // next list waiting to be freed, see retireTopList
+    wchar_t text[];                 // the words, NUL separated
+} NgramTopList;
+
+typedef struct NgramContext {
+    long total;                // summed count of every continuation
+    NgramTopList *top;
+} NgramContext;
+
+// Reclaiming replaced lists, epoch based. Every thread that reads published
+// lists owns a slot of its own, claimed on first use and given back when the
+// thread exits. A read is bracketed by topListEnter, which announces in the
+// thread's slot the epoch it saw, and topListLeave, which clears it; neither
+// touches memory shared with other readers but for reading the epoch. A
+// replaced list is retired into the bucket of the current epoch. The epoch
+// moves from e to e+1 only once every reader still inside announces e, so by
+// then no reader can hold a list retired in e-2 or earlier, and that bucket,
+// which e+1 reuses, is freed. Every retirement tries to move the epoch on.
+// Readers hold a list for one copy of at most NGRAM_TOP_K entries, so an
+// epoch drains within microseconds. The lists waiting at any time are those
+// retired in the current and the two previous epochs, however long learning
+// runs. Reads must not nest, and at most TOP_LIST_READERS threads can read at
+// once.
+
+#define TOP_LIST_EPOCHS 3
+#define TOP_LIST_READERS 256
+
+typedef struct TopListEpochs {
+    unsigned long epoch;
+    int slotCount;              // slots claimed so far, the ones retirements check
+    struct {
+        unsigned long announced;   // 2 * epoch + 1 while reading, 0 otherwise
+        int owned;
+        char pad[52];           // one cache line per reader
+    } slots[TOP_LIST_READERS];
+    NgramTopList *retired[TOP_LIST_EPOCHS];
+    pthread_mutex_t lock;       // slot claims, retirements and epoch changes
+    pthread_once_t once;
+    pthread_key_t owner;        // gives the slot back when its thread exits
+} TopListEpochs;
+
+TopListEpochs topListEpochs = { .lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT };
+static __thread int topListSlot = -1;
+
+static void releaseTopListSlot(void *slot) {
+    __atomic_store_n(&topListEpochs.slots[(long)slot - 1].owned, 0, __ATOMIC_RELEASE);
+}
+
+static void createTopListOwnerKey(void) {
+    pthread_key_create(&topListEpochs.owner, releaseTopListSlot);
+}
+
+// The calling thread's slot, claimed on its first read.
+static int claimTopListSlot(void) {
+    TopListEpochs *epochs = &topListEpochs;
+    pthread_once(&epochs->once, createTopListOwnerKey);
+    pthread_mutex_lock(&epochs->lock);
+    int slot = 0;
+    while (slot < TOP_LIST_READERS && epochs->slots[slot].owned) slot++;
+    if (slot == TOP_LIST_READERS) {
+        fprintf(stderr, "More than %d threads reading continuation lists\n", TOP_LIST_READERS);
+        exit(1);
+    }
+    epochs->slots[slot].owned = 1;
+    if (slot >= epochs->slotCount) epochs->slotCount = slot + 1;
+    pthread_mutex_unlock(&epochs->lock);
+    pthread_setspecific(epochs->owner, (void *)(long)(slot + 1));
+    return topListSlot = slot;
+}
+
+// Starts reading published lists.
+void topListEnter(void) {
+    int slot = topListSlot >= 0 ? topListSlot : claimTopListSlot();
+    unsigned long epoch = __atomic_load_n(&topListEpochs.epoch, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&topListEpochs.slots[slot].announced, 2 * epoch + 1, __ATOMIC_RELAXED);
+    // The announcement must be visible before any list is read.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void topListLeave(void) {
+    __atomic_store_n(&topListEpochs.slots[topListSlot].announced, 0, __ATOMIC_RELEASE);
+}
+
+// Hands over a list no longer reachable from its context, to be freed once
+// no reader can hold it.
+void retireTopList(NgramTopList *list) {
+    TopListEpochs *epochs = &topListEpochs;
+    NgramTopList *reclaimed = NULL;
+
+    pthread_mutex_lock(&epochs->lock);
+    unsigned long epoch = epochs->epoch;
+    list->retired = epochs->retired[epoch % TOP_LIST_EPOCHS];
+    epochs->retired[epoch % TOP_LIST_EPOCHS] = list;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int behind = 0;
+    for (int i = 0; i < epochs->slotCount && !behind; i++) {
+        unsigned long announced = __atomic_load_n(&epochs->slots[i].announced, __ATOMIC_ACQUIRE);
+        behind = announced != 0 && announced != 2 * epoch + 1;
+    }
+    if (!behind) {
+        reclaimed = epochs->retired[(epoch + 1) % TOP_LIST_EPOCHS];   // retired in epoch - 2
+        epochs->retired[(epoch + 1) % TOP_LIST_EPOCHS] = NULL;
+        __atomic_store_n(&epochs->epoch, epoch + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&epochs->lock);
+
+    while (reclaimed) {
+        NgramTopList *next = reclaimed->retired;
+        free(reclaimed);
+        reclaimed = next;
+    }
+}
+
+// Allocates a list for count words (nodes[i] ending words[i]).
+NgramTopList *createTopList(int count, ngramTrieNode **nodes, const wchar_t **words) {
+    size_t textLen = 0;
+    for (int i = 0; i < count; i++) textLen += wcslen(words[i]) + 1;
+
+    NgramTopList *list = malloc(sizeof(NgramTopList) + textLen * sizeof(wchar_t));
+    if (!list) {
+        fprintf(stderr, "Out of memory for continuation list\n");
+        exit(1);
+    }
+    list->count = count;
+    list->retired = NULL;
+    wchar_t *p = list->text;
+    for (int i = 0; i < count; i++) {
+        wcscpy(p, words[i]);
+        list->entries[i].node = nodes[i];
+        list->entries[i].word = p;
+        p += wcslen(words[i]) + 1;
+    }
+    return list;
+}
+
+// Like collectNextWords, but also records the end node of each kept word.
+void collectTopEntries(ngramTrieNode *node, wchar_t *buffer, int depth, Suggestion *top,
+                       ngramTrieNode **nodes, int *count, long *total) {
+    if (depth >= MAX_PHRASE_LEN - 1) return;
+
+    if (node->isEndOfWord && depth > 0) {
+        buffer[depth] = L'\0';
+        *total += node->frequency;
+        if (*count < NGRAM_TOP_K || top[NGRAM_TOP_K - 1].frequency < node->frequency) {
+            int i = (*count < NGRAM_TOP_K) ? (*count)++ : NGRAM_TOP_K - 1;
+            while (i > 0 && top[i - 1].frequency < node->frequency) {
+                top[i] = top[i - 1];
+                nodes[i] = nodes[i - 1];
+                i--;
+            }
+            wcscpy(top[i].phrase, buffer);
+            top[i].frequency = node->frequency;
+            nodes[i] = node;
+        }
+    }
+
+    for (int i = 1; i <= MAX_DEVA_CHARS; i++) {
+        if (node->children[i]) {
+            buffer[depth] = (wchar_t)(UNICODE_BASE + i - 1);
+            collectTopEntries(node->children[i], buffer, depth + 1, top, nodes, count, total);
+        }
+    }
+}
+
+// Working space of buildContinuationLists, shared by all levels of the walk
+// instead of sitting in every stack frame.
+typedef struct ContinuationScratch {
+    Suggestion top[NGRAM_TOP_K];
+    ngramTrieNode *nodes[NGRAM_TOP_K];
+    const wchar_t *words[NGRAM_TOP_K];
+    wchar_t buffer[MAX_PHRASE_LEN];
+} ContinuationScratch;
+
+static void attachContinuationLists(ngramTrieNode *node, ContinuationScratch *scratch) {
+    for (int i = 0; i <= MAX_DEVA_CHARS; i++) {
+        ngramTrieNode *child = node->children[i];
+        if (!child) continue;
+
+        if (i == 0 && !child->context) {
+            int count = 0;
+            long total = 0;
+            collectTopEntries(child, scratch->buffer, 0, scratch->top, scratch->nodes, &count, &total);
+            if (count > 0) {
+                for (int j = 0; j < count; j++) scratch->words[j] = scratch->top[j].phrase;
+                child->context = malloc(sizeof(NgramContext));
+                if (!child->context) {
+                    fprintf(stderr, "Out of memory for continuation list\n");
+                    exit(1);
+                }
+                child->context->total = total;
+                child->context->top = createTopList(count, scratch->nodes, scratch->words);
+            }
+        }
+        attachContinuationLists(child, scratch);
+    }
+}
+
+// Build-time pass: attaches a context to every node after a space. Each node
+// is visited once by the walk and once by the list of its nearest context.
+void buildContinuationLists(ngramTrieNode *node) {
+    ContinuationScratch *scratch = malloc(sizeof(ContinuationScratch));
+    if (!scratch) {
+        fprintf(stderr, "Out of memory for continuation list\n");
+        exit(1);
+    }
+    attachContinuationLists(node, scratch);
+    free(scratch);
+}
+
+// Copies the continuations of a context node (reached by "context ") into top,
+// most frequent first, and returns how many; *total receives the summed count
+// of every continuation. Costs one list copy whatever the subtree size, and
+// stops early once budget expires (NULL for no limit).
+int lookupContinuations(ngramTrieNode *node, Suggestion *top, int limit, long *total, RequestBudget *budget) {
+    int count = 0;
+    *total = 0;
+    NgramContext *context = node ? __atomic_load_n(&node->context, __ATOMIC_ACQUIRE) : NULL;
+    if (!context) return 0;
+
+    topListEnter();
+    NgramTopList *list = __atomic_load_n(&context->top, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < list->count && !budgetExpired(budget); i++)
+        insertTopSuggestion(top, &count, limit, list->entries[i].word,
+                            __atomic_load_n(&list->entries[i].node->frequency, __ATOMIC_RELAXED));
+    topListLeave();
+    *total = __atomic_load_n(&context->total, __ATOMIC_RELAXED);
+    return count;
+}
+
 wchar_t** searchNgramSuggestions(wchar_t *w1, wchar_t *w2, wchar_t *w3, wchar_t *w4,ngramTrieNode *root, int *count) {
     *count = 0;
-    fwprintf(stderr, L"Context: w1=%ls w2=%ls w3=%ls w4=%ls\n", w1, w2, w3, w4);
+    LOG(LOG_DEBUG, L"Context: w1=%ls w2=%ls w3=%ls w4=%ls", w1, w2, w3, w4);
     wchar_t context[256] = L"";
     if (w1) wcscat(context, w1);
     if (w2) { wcscat(context, L" "); wcscat(context, w2); }
     if (w3) { wcscat(context, L" "); wcscat(context, w3); }
     if (w4) { wcscat(context, L" "); wcscat(context, w4); }
-    
-
-    ngramTrieNode *startNode = traverseContext(root, context);
-    if (!startNode) return NULL;
+    wcscat(context, L" ");
 
     Suggestion suggestions[MAX_RESULTS];
-    wchar_t buffer[MAX_PHRASE_LEN];
-    *count = 0;
-    wmemset(buffer, 0, MAX_PHRASE_LEN);
-    collectSuggestions(startNode, buffer, 0, suggestions, count);
+    long total;
+    *count = lookupContinuations(traverseContext(root, context), suggestions, MAX_RESULTS, &total, NULL);
+    if (*count == 0) return NULL;
 
-    qsort(suggestions, *count, sizeof(Suggestion), compareSuggestions);
-    
     wchar_t **results = malloc(sizeof(wchar_t *) * (*count));
     for (int i = 0; i < *count; i++) {
     	size_t inputLen = wcslen(context);  
     	size_t suggLen = wcslen(suggestions[i].phrase);
     	results[i] = malloc(sizeof(wchar_t) * (inputLen + suggLen + 1));
-    	wcscpy(results[i], context);                         // Copy input word
+    	wcscpy(results[i], context);                         // Copy input words
     	wcscat(results[i], suggestions[i].phrase);      // Directly append suggestion 
     }
 
@@ -112,6 +396,7 @@ ngramTrieNode* createNgramNode() {
     ngramTrieNode *node = (ngramTrieNode*)malloc(sizeof(ngramTrieNode));
     node->isEndOfWord = 0;
     node->frequency = 0;
+    node->context = NULL;
     for (int i = 0; i <= MAX_DEVA_CHARS; i++)
         node->children[i] = NULL;
     return node;
@@ -146,6 +431,119 @@ void insertNgram(ngramTrieNode *root, const wchar_t *ngram) {
     current->frequency += 1;
 }
 
+// Lock-free child lookup/creation for learning on a live trie (see
+// getOrCreateChild). Counts a node it adds in *created.
+ngramTrieNode *getOrCreateNgramChild(ngramTrieNode *node, int offset, int *created) {
+    ngramTrieNode *child = __atomic_load_n(&node->children[offset], __ATOMIC_ACQUIRE);
+    if (child) return child;
+
+    ngramTrieNode *fresh = createNgramNode();
+    if (__atomic_compare_exchange_n(&node->children[offset], &child, fresh, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        (*created)++;
+        return fresh;
+    }
+
+    free(fresh);
+    return child;
+}
+
+// Keeps the context of a learned n-gram in step: adds delta to its total and,
+// if the word now beats the weakest listed continuation, publishes a new list.
+void noteContinuation(ngramTrieNode *contextNode, ngramTrieNode *end, const wchar_t *word,
+                      int frequency, int delta) {
+    NgramContext *context = __atomic_load_n(&contextNode->context, __ATOMIC_ACQUIRE);
+    if (!context) {
+        NgramContext *fresh = malloc(sizeof(NgramContext));
+        if (!fresh) return;
+        fresh->total = 0;
+        fresh->top = createTopList(0, NULL, NULL);
+        if (__atomic_compare_exchange_n(&contextNode->context, &context, fresh, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            context = fresh;
+        } else {
+            free(fresh->top);
+            free(fresh);
+        }
+    }
+    __atomic_fetch_add(&context->total, delta, __ATOMIC_RELAXED);
+
+    topListEnter();
+    NgramTopList *list = __atomic_load_n(&context->top, __ATOMIC_ACQUIRE);
+    while (1) {
+        ngramTrieNode *nodes[NGRAM_TOP_K];
+        const wchar_t *words[NGRAM_TOP_K];
+        int weakest = -1, weakestFrequency = 0, count = list->count;
+
+        for (int i = 0; i < count; i++) {
+            if (list->entries[i].node == end) {   // listed, its count is read live
+                topListLeave();
+                return;
+            }
+            int f = __atomic_load_n(&list->entries[i].node->frequency, __ATOMIC_RELAXED);
+            if (weakest < 0 || f < weakestFrequency) {
+                weakest = i;
+                weakestFrequency = f;
+            }
+            nodes[i] = list->entries[i].node;
+            words[i] = list->entries[i].word;
+        }
+        if (count == NGRAM_TOP_K && frequency <= weakestFrequency) {
+            topListLeave();
+            return;
+        }
+
+        int slot = count < NGRAM_TOP_K ? count++ : weakest;
+        nodes[slot] = end;
+        words[slot] = word;
+        NgramTopList *fresh = createTopList(count, nodes, words);
+        NgramTopList *replaced = list;
+        if (__atomic_compare_exchange_n(&context->top, &list, fresh, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            topListLeave();
+            retireTopList(replaced);
+            return;
+        }
+        free(fresh);   // another learner won; list now holds its list, retry
+    }
+}
+
+// Same walk as insertNgram, but safe against concurrent searches and learners.
+// Returns how many nodes it added to the trie.
+int learnNgram(ngramTrieNode *root, const wchar_t *ngram, int delta) {
+    ngramTrieNode *current = root, *contextNode = NULL;
+    wchar_t word[MAX_PHRASE_LEN];
+    int wordLen = 0, created = 0;
+
+    for (const wchar_t *p = ngram; *p; p++) {
+        int offset;
+        if (*p == L' ') {
+            offset = 0;
+        } else {
+            offset = (*p - UNICODE_BASE) + 1;
+            if (offset <= 0 || offset > MAX_DEVA_CHARS) continue;
+        }
+        current = getOrCreateNgramChild(current, offset, &created);
+        if (offset == 0) {
+            contextNode = current;
+            wordLen = 0;
+        } else if (wordLen < MAX_PHRASE_LEN - 1) {
+            word[wordLen++] = *p;
+        }
+    }
+
+    if (current == root) return created;
+    if (!__atomic_load_n(&current->isEndOfWord, __ATOMIC_RELAXED))
+        __atomic_store_n(&current->isEndOfWord, 1, __ATOMIC_RELEASE);
+    int frequency = __atomic_add_fetch(&current->frequency, delta, __ATOMIC_RELAXED);
+
+    if (contextNode && wordLen > 0) {
+        word[wordLen] = L'\0';
+        noteContinuation(contextNode, current, word, frequency, delta);
+    }
+    return created;
+}
+
 // Display Trie 
 void displayNgramTrie(ngramTrieNode *root, wchar_t *buffer, int depth) {
     if (root->isEndOfWord) {
@@ -171,12 +569,14 @@ void freeNgramTrie(ngramTrieNode *root) {
         if (root->children[i])
             freeNgramTrie(root->children[i]);
     }
+    if (root->context) {
+        free(root->context->top);
+        free(root->context);
+    }
     free(root);
 }
 
 ngramTrieNode *buildNgramTrie(const char *filepath) {
-   	
-       	setlocale(LC_ALL, "");
 
         ngramTrieNode *root = createNgramNode();
         wchar_t buffer[MAX_NGRAM_LEN];
@@ -194,12 +594,14 @@ ngramTrieNode *buildNgramTrie(const char *filepath) {
             if ((pos = wcschr(line, L'\n')) != NULL) *pos = L'\0';
             if ((pos = wcschr(line, L'\r')) != NULL) *pos = L'\0';
 
+            normalizeDevanagari(line, line, MAX_NGRAM_LEN);
             if (wcslen(line) > 0 && wcscspn(line, L"\x00-\x08\x0B\x0C\x0E-\x1F") == wcslen(line)) {
                 insertNgram(root, line);
             }
         }
 
         fclose(file);
+        buildContinuationLists(root);
 
         wprintf(L"Ngrams in File: %s \n", filepath);
         //displayNgramTrie(root, buffer, 0);
@@ -14,6 +14,7 @@ int isHindi(wchar_t ch) {
 void write_ngrams(FILE *foutptr, wchar_t words[][MAX_WORDLEN], int total_words) {
     for (int n = 2; n <= 5; n++) {
         for (int i = 0; i <= total_words - n; i++) {
+            if (!ownsNgram(words[i])) continue;   // another backend's, see shard_hi.c
             for (int j = 0; j < n; j++) {
                 fputws(words[i + j], foutptr);
                 if (j != n - 1) fputwc(L' ', foutptr);
@@ -23,14 +24,56 @@ void write_ngrams(FILE *foutptr, wchar_t words[][MAX_WORDLEN], int total_words)
     }
 }
 
-void generateNgrams(int filecount, char *filepath[]) {
-    setlocale(LC_ALL, "en_US.UTF-8");
+// Splits a corpus file into normalized Hindi words, at most MAX_WORDS.
+// Returns the number of words stored in words.
+int tokenizeCorpusFile(FILE *finptr, wchar_t words[][MAX_WORDLEN]) {
+    int word_index = 0, char_index = 0;
+    wint_t ch;
+
+    while ((ch = fgetwc(finptr)) != WEOF) {
+        if (iswspace(ch) || ch == L'।' || ch == L'.' || ch == L',' || ch == L'?' || ch == L'\'') {
+            if (char_index > 0) {
+                words[word_index][char_index] = L'\0';
+                normalizeDevanagari(words[word_index], words[word_index], MAX_WORDLEN);
+                word_index++;
+                char_index = 0;
+                if (word_index >= MAX_WORDS) break;
+            }
+        } else if (isHindi(ch)) {
+            if (char_index < MAX_WORDLEN - 1) {
+                words[word_index][char_index++] = ch;
+            }
+        }
+    }
+
+    // Add last word if needed
+    if (char_index > 0 && word_index < MAX_WORDS) {
+        words[word_index][char_index] = L'\0';
+        normalizeDevanagari(words[word_index], words[word_index], MAX_WORDLEN);
+        word_index++;
+    }
+    return word_index;
+}
+
+// prefix is prepended to every generated file name so that several models
+// can build side by side in the same working directory. grams(prefix) then
+// splits the result by order. The n-gram file is rewritten from scratch on
+// every build; files added later are merged by "!ingest" (see ingest_hi.c).
+void generateNgrams(int filecount, char *filepath[], const char *prefix) {
     FILE *finptr, *foutptr;
-    foutptr = fopen("ngrams.txt", "a");
+    char ngramsPath[256];
+    snprintf(ngramsPath, sizeof(ngramsPath), "%sngrams.txt", prefix);
+    foutptr = fopen(ngramsPath, "w");
     if (foutptr == NULL) {
         wprintf(L"Cannot open output file\n");
         exit(1);
     }
+    // Too large for the stack of the loader thread that runs this
+    wchar_t (*words)[MAX_WORDLEN] = malloc(sizeof(wchar_t[MAX_WORDS][MAX_WORDLEN]));
+    if (!words) {
+        fprintf(stderr, "Out of memory for corpus words\n");
+        exit(1);
+    }
 
     for (int i = 0; i < filecount; i++) {
         finptr = fopen(filepath[i], "r");
@@ -39,38 +82,13 @@ void generateNgrams(int filecount, char *filepath[]) {
             continue;
         }
 
-        wchar_t words[MAX_WORDS][MAX_WORDLEN];
-        int word_index = 0, char_index = 0;
-        wint_t ch;
-
-        while ((ch = fgetwc(finptr)) != WEOF) {
-            if (iswspace(ch) || ch == L'।' || ch == L'.' || ch == L',' || ch == L'?' || ch == L'\'') {
-                if (char_index > 0) {
-                    words[word_index][char_index] = L'\0';
-                    word_index++;
-                    char_index = 0;
-                    if (word_index >= MAX_WORDS) break;
-                }
-            } else if (isHindi(ch)) {
-                if (char_index < MAX_WORDLEN - 1) {
-                    words[word_index][char_index++] = ch;
-                }
-            }
-        }
-
-        // Add last word if needed
-        if (char_index > 0 && word_index < MAX_WORDS) {
-            words[word_index][char_index] = L'\0';
-            word_index++;
-        }
-
+        int word_index = tokenizeCorpusFile(finptr, words);
         write_ngrams(foutptr, words, word_index);
 
         fclose(finptr);
         wprintf(L"Generated n-grams from: %s\n", filepath[i]);
     }
 
+    free(words);
     fclose(foutptr);
-     grams();
 }
-
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+// Devanagari normalization: one spelling for letters the corpus writes in
+// more than one way, so the tries never hold the same word twice.
+//
+//   - a consonant followed by the nukta sign becomes its precomposed letter
+//     (ड + ़ -> ड़); the precomposed forms are one character and one trie level
+//   - chandrabindu folds into anusvara (हूँ -> हूं)
+//   - zero width joiner and non-joiner are dropped
+//
+// Both tables cover the Devanagari block U+0900..U+097F and are indexed by the
+// offset into it; a zero entry means the character is kept as it is. The same
+// single pass runs over corpus text at ingestion and over every request.
+
+#define DEVA_BLOCK_BASE 0x0900
+#define DEVA_BLOCK_SIZE 128
+#define DEVA_NUKTA L'\x093C'
+#define ZERO_WIDTH_NON_JOINER L'\x200C'
+#define ZERO_WIDTH_JOINER L'\x200D'
+
+// Replacement for a character on its own.
+static const wchar_t devaFolds[DEVA_BLOCK_SIZE] = {
+    [0x01] = L'\x0902',     // chandrabindu -> anusvara
+};
+
+// Precomposed letter for a consonant followed by the nukta sign.
+static const wchar_t devaNuktaForms[DEVA_BLOCK_SIZE] = {
+    [0x15] = L'\x0958',     // क़
+    [0x16] = L'\x0959',     // ख़
+    [0x17] = L'\x095A',     // ग़
+    [0x1C] = L'\x095B',     // ज़
+    [0x21] = L'\x095C',     // ड़
+    [0x22] = L'\x095D',     // ढ़
+    [0x2B] = L'\x095E',     // फ़
+    [0x2F] = L'\x095F',     // य़
+    [0x28] = L'\x0929',     // ऩ
+    [0x30] = L'\x0931',     // ऱ
+    [0x33] = L'\x0934',     // ऴ
+};
+
+static int inDevaBlock(wchar_t ch) {
+    return ch >= DEVA_BLOCK_BASE && ch < DEVA_BLOCK_BASE + DEVA_BLOCK_SIZE;
+}
+
+// Writes the normalized form of in to out, which holds size characters
+// including the terminator. The result is never longer than the input, so out
+// may be in itself. Returns the length written.
+size_t normalizeDevanagari(wchar_t *out, const wchar_t *in, size_t size) {
+    size_t len = 0;
+    if (size == 0) return 0;
+
+    for (; *in && len + 1 < size; in++) {
+        wchar_t ch = *in;
+        if (ch == ZERO_WIDTH_JOINER || ch == ZERO_WIDTH_NON_JOINER) continue;
+
+        if (inDevaBlock(ch)) {
+            if (ch == DEVA_NUKTA && len > 0 && inDevaBlock(out[len - 1]) &&
+                devaNuktaForms[out[len - 1] - DEVA_BLOCK_BASE]) {
+                out[len - 1] = devaNuktaForms[out[len - 1] - DEVA_BLOCK_BASE];
+                continue;
+            }
+            if (devaFolds[ch - DEVA_BLOCK_BASE]) ch = devaFolds[ch - DEVA_BLOCK_BASE];
+        }
+        out[len++] = ch;
+    }
+    out[len] = L'\0';
+    return len;
+}
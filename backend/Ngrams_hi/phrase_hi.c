@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// Multi-word phrase completion: bounded beam search over the n-gram tries.
+//
+// Each step extends every hypothesis by one word. The next-word distribution
+// comes from the highest-order trie that knows the hypothesis' last words
+// (up to four). Lower orders are used with a fixed backoff penalty. Only the
+// beamWidth best hypotheses survive a step, and those far below the best are
+// pruned. The cost per request is therefore bounded by
+// depth * beamWidth context lookups.
+
+#define DEFAULT_PHRASE_BEAM_WIDTH 4
+#define DEFAULT_PHRASE_DEPTH 3
+#define MAX_PHRASE_BEAM_WIDTH 16
+#define MAX_PHRASE_RESULTS 10
+#define PHRASE_BACKOFF_PENALTY 0.4     // per skipped n-gram order ("stupid backoff")
+#define PHRASE_PRUNE_RATIO 0.001       // drop hypotheses scoring below best * ratio
+
+typedef struct PhraseHypothesis {
+    wchar_t text[MAX_NGRAM_LEN];   // context followed by the proposed words
+    int proposedWords;
+    double score;                  // product of next-word probabilities
+} PhraseHypothesis;
+
+// Finds the next-word candidates of text in tables[0..3] (bigram..fivegram).
+// Returns the number stored in top; *scale receives the backoff factor the
+// probabilities must be multiplied with, and *total their denominator.
+int nextWordCandidates(NgramTable *tables[4], const wchar_t *text, Suggestion *top, int limit,
+                       long *total, double *scale, RequestBudget *budget) {
+    const wchar_t *starts[4];
+    int words = 0;
+
+    // Start offsets of the last (up to) four words, most recent first.
+    for (const wchar_t *p = text + wcslen(text); p > text && words < 4; ) {
+        while (p > text && p[-1] == L' ') p--;
+        const wchar_t *end = p;
+        while (p > text && p[-1] != L' ') p--;
+        if (p < end) starts[words++] = p;
+    }
+
+    *scale = 1.0;
+    for (int order = words; order >= 1 && !budgetExpired(budget); order--) {
+        if (tables[order - 1]) {
+            wchar_t context[MAX_NGRAM_LEN];
+            int shard;
+            swprintf(context, MAX_NGRAM_LEN, L"%ls ", starts[order - 1]);
+            ngramTrieNode *root = acquireNgramTable(tables[order - 1], context, &shard);
+            int count = lookupContinuations(traverseContext(root, context), top, limit, total, budget);
+            releaseNgramTable(tables[order - 1], shard);
+            if (count > 0 && *total > 0) return count;
+        }
+        *scale *= PHRASE_BACKOFF_PENALTY;
+    }
+    return 0;
+}
+
+int compareHypotheses(const void *a, const void *b) {
+    double sa = ((PhraseHypothesis *)a)->score, sb = ((PhraseHypothesis *)b)->score;
+    return (sa < sb) - (sa > sb);
+}
+
+// Proposes up to depth words following context. Returns a malloc'ed array of
+// "context word1 word2 ..." strings, best first, in the format of
+// searchNgramSuggestions; *count receives its length.
+wchar_t **searchPhraseCompletions(NgramTable *tables[4], const wchar_t *context, int beamWidth, int depth,
+                                  int *count, RequestBudget *budget) {
+    *count = 0;
+    if (beamWidth < 1) beamWidth = 1;
+    if (beamWidth > MAX_PHRASE_BEAM_WIDTH) beamWidth = MAX_PHRASE_BEAM_WIDTH;
+
+    PhraseHypothesis *beam = malloc(sizeof(PhraseHypothesis) * MAX_PHRASE_BEAM_WIDTH);
+    PhraseHypothesis *next = malloc(sizeof(PhraseHypothesis) * MAX_PHRASE_BEAM_WIDTH * (MAX_PHRASE_BEAM_WIDTH + 1));
+    if (!beam || !next) {
+        free(beam);
+        free(next);
+        return NULL;
+    }
+
+    int beamSize = 1;
+    wcsncpy(beam[0].text, context, MAX_NGRAM_LEN - 1);
+    beam[0].text[MAX_NGRAM_LEN - 1] = L'\0';
+    size_t len = wcslen(beam[0].text);
+    while (len > 0 && beam[0].text[len - 1] == L' ') beam[0].text[--len] = L'\0';
+    beam[0].proposedWords = 0;
+    beam[0].score = 1.0;
+
+    for (int step = 0; step < depth && !budgetExpired(budget); step++) {
+        int nextSize = 0, extended = 0;
+        for (int h = 0; h < beamSize; h++) {
+            Suggestion top[MAX_PHRASE_BEAM_WIDTH];
+            long total = 0;
+            double scale = 1.0;
+            int found = nextWordCandidates(tables, beam[h].text, top, beamWidth, &total, &scale, budget);
+
+            // Hypotheses that cannot be extended compete as they are.
+            if (found == 0) {
+                next[nextSize++] = beam[h];
+                continue;
+            }
+            for (int i = 0; i < found; i++) {
+                PhraseHypothesis *hyp = &next[nextSize];
+                if (wcslen(beam[h].text) + 1 + wcslen(top[i].phrase) >= MAX_NGRAM_LEN) continue;
+                swprintf(hyp->text, MAX_NGRAM_LEN, L"%ls %ls", beam[h].text, top[i].phrase);
+                hyp->proposedWords = beam[h].proposedWords + 1;
+                hyp->score = beam[h].score * scale * top[i].frequency / (double)total;
+                nextSize++;
+                extended = 1;
+            }
+        }
+        if (!extended) break;
+
+        qsort(next, nextSize, sizeof(PhraseHypothesis), compareHypotheses);
+        beamSize = 0;
+        for (int i = 0; i < nextSize && beamSize < beamWidth; i++) {
+            if (next[i].score < next[0].score * PHRASE_PRUNE_RATIO) break;
+            beam[beamSize++] = next[i];
+        }
+    }
+
+    wchar_t **results = malloc(sizeof(wchar_t *) * MAX_PHRASE_RESULTS);
+    for (int i = 0; results && i < beamSize && *count < MAX_PHRASE_RESULTS; i++) {
+        if (beam[i].proposedWords == 0) continue;
+        results[*count] = wcsdup(beam[i].text);
+        if (results[*count]) (*count)++;
+    }
+
+    free(beam);
+    free(next);
+    return results;
+}
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// Unified ranking of suggestions.
+//
+// Every source (n-gram continuations, completion of a partial word from its
+// context, dictionary prefix completion, fuzzy matches) offers scored
+// candidates into one bounded min-heap holding the TOP_SUGGESTIONS best.
+// Candidates naming the same word at the same position are merged and keep
+// the better score. The heap is the only place where results are ranked and
+// written out.
+//
+// A score is tier * TIER_SCALE + frequency: any candidate of a higher tier
+// beats every candidate of a lower one, and frequency orders within a tier.
+// Walks compare their best possible score with the heap minimum and skip
+// what cannot place.
+//
+// A request can name word categories (WORD_* in dict_trie.c) to keep only, or
+// to prefer: preferred words gain CATEGORY_BOOST, half a tier, so they lead
+// their tier without overtaking a better one. Dictionary walks skip subtrees
+// holding no wanted category, so a filtered walk costs no more than a plain
+// one.
+
+#define TOP_SUGGESTIONS 10
+#define MAX_CANDIDATE_LEN 256
+#define TIER_SCALE 1e12
+
+// Tiers, best first. Context tiers add the number of context words matched.
+#define TIER_NGRAM 10          // 11..14: next word after 1..4 context words
+#define TIER_CONTEXT_PREFIX 5  //  6..9: partial word completed after 1..4 context words
+#define TIER_PREFIX 3          // dictionary completion of the partial word
+#define TIER_FUZZY 2           // 0..2: fuzzy match, minus the edits used
+#define CATEGORY_BOOST (TIER_SCALE / 2)
+
+typedef struct Candidate {
+    wchar_t text[MAX_CANDIDATE_LEN];   // the line sent to the client
+    int keyStart;                      // text + keyStart names the word (or phrase)
+    int position;                      // index of that word in the request
+    const void *wordId;                // dictionary node of the word, or NULL
+    double score;
+} Candidate;
+
+typedef struct CandidateHeap {
+    Candidate items[TOP_SUGGESTIONS];  // min-heap on score
+    int size;
+    unsigned char only;                // WORD_* categories to keep, 0 for all
+    unsigned char prefer;              // WORD_* categories to boost, 0 for none
+} CandidateHeap;
+
+char* to_utf8(const wchar_t* wstr) {
+    if (!wstr) return NULL;
+
+    size_t len = wcstombs(NULL, wstr, 0);
+    if (len == (size_t)-1) {
+        // Conversion failed
+        return NULL;
+    }
+
+    char *mbstr = (char *)malloc(len + 1); // +1 for null terminator
+    if (!mbstr) return NULL;
+
+    wcstombs(mbstr, wstr, len + 1);
+    return mbstr;
+}
+
+double candidateScore(int tier, int frequency) {
+    return tier * TIER_SCALE + (frequency > 0 ? frequency : 0);
+}
+
+// CATEGORY_BOOST for a word of a preferred category, otherwise 0.
+double categoryBonus(CandidateHeap *heap, unsigned char categories) {
+    return categories & heap->prefer ? CATEGORY_BOOST : 0;
+}
+
+// True if a word of these categories passes the request's filter.
+int categoryWanted(CandidateHeap *heap, unsigned char categories) {
+    return !heap->only || (categories & heap->only);
+}
+
+// True if a candidate scoring best could still enter the heap.
+int heapAccepts(CandidateHeap *heap, double best) {
+    return heap->size < TOP_SUGGESTIONS || best > heap->items[0].score;
+}
+
+void heapSwap(CandidateHeap *heap, int a, int b) {
+    Candidate tmp = heap->items[a];
+    heap->items[a] = heap->items[b];
+    heap->items[b] = tmp;
+}
+
+void heapSiftDown(CandidateHeap *heap, int i) {
+    while (1) {
+        int smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < heap->size && heap->items[l].score < heap->items[smallest].score) smallest = l;
+        if (r < heap->size && heap->items[r].score < heap->items[smallest].score) smallest = r;
+        if (smallest == i) return;
+        heapSwap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+void heapSiftUp(CandidateHeap *heap, int i) {
+    while (i > 0 && heap->items[(i - 1) / 2].score > heap->items[i].score) {
+        heapSwap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void setCandidate(Candidate *c, const wchar_t *text, int keyStart, int position, const void *wordId, double score) {
+    wcsncpy(c->text, text, MAX_CANDIDATE_LEN - 1);
+    c->text[MAX_CANDIDATE_LEN - 1] = L'\0';
+    c->keyStart = keyStart;
+    c->position = position;
+    c->wordId = wordId;
+    c->score = score;
+}
+
+void offerCandidate(CandidateHeap *heap, const wchar_t *text, int keyStart, int position,
+                    const void *wordId, double score) {
+    // A copy already in the heap scores at least the minimum, so nothing to do.
+    if (!heapAccepts(heap, score)) return;
+
+    for (int i = 0; i < heap->size; i++) {
+        Candidate *c = &heap->items[i];
+        if (c->position != position) continue;
+        if (wordId && c->wordId ? wordId != c->wordId
+                                : wcscmp(c->text + c->keyStart, text + keyStart) != 0) continue;
+        if (score > c->score) {
+            setCandidate(c, text, keyStart, position, wordId, score);
+            heapSiftDown(heap, i);
+        }
+        return;
+    }
+
+    if (heap->size < TOP_SUGGESTIONS) {
+        setCandidate(&heap->items[heap->size], text, keyStart, position, wordId, score);
+        heapSiftUp(heap, heap->size++);
+    } else {
+        setCandidate(&heap->items[0], text, keyStart, position, wordId, score);
+        heapSiftDown(heap, 0);
+    }
+}
+
+int compareCandidates(const void *a, const void *b) {
+    double sa = ((Candidate *)a)->score, sb = ((Candidate *)b)->score;
+    return (sa < sb) - (sa > sb);
+}
+
+// Writes the candidates best first, one UTF-8 line each, and empties the heap.
+// withScores prefixes each line with its score and a tab, for the router.
+void writeCandidates(CandidateHeap *heap, FILE *out, int withScores) {
+    qsort(heap->items, heap->size, sizeof(Candidate), compareCandidates);
+    for (int i = 0; i < heap->size; i++) {
+        char *utf8str = to_utf8(heap->items[i].text);
+        if (utf8str) {
+            if (withScores) fprintf(out, "%.0f\t", heap->items[i].score);
+            fprintf(out, "%s\n", utf8str);
+            LOG(LOG_DEBUG, L"Suggestion[%d]: %ls", i, heap->items[i].text);
+            free(utf8str);
+        } else {
+            LOG(LOG_WARN, L"UTF-8 conversion failed for suggestion[%d]: %ls", i, heap->items[i].text);
+        }
+    }
+    heap->size = 0;
+}
+
+// The words of a request, split once and shared by every source.
+typedef struct QueryWords {
+    wchar_t buffer[MAX_CANDIDATE_LEN];
+    wchar_t *tokens[64];
+    int count;
+} QueryWords;
+
+void splitQueryWords(QueryWords *words, const wchar_t *input) {
+    wchar_t *state = NULL;
+    wcsncpy(words->buffer, input, MAX_CANDIDATE_LEN - 1);
+    words->buffer[MAX_CANDIDATE_LEN - 1] = L'\0';
+    words->count = 0;
+    for (wchar_t *token = wcstok(words->buffer, L" ", &state); token && words->count < 64;
+         token = wcstok(NULL, L" ", &state))
+        words->tokens[words->count++] = token;
+}
+
+// Joins tokens[from..to) with single spaces, followed by a space if
+// trailingSpace is set and anything was written.
+void joinQueryWords(QueryWords *words, int from, int to, int trailingSpace, wchar_t *out) {
+    out[0] = L'\0';
+    for (int i = from < 0 ? 0 : from; i < to; i++) {
+        if (wcslen(out) + wcslen(words->tokens[i]) + 2 >= MAX_CANDIDATE_LEN) break;
+        if (out[0]) wcscat(out, L" ");
+        wcscat(out, words->tokens[i]);
+    }
+    if (trailingSpace && out[0]) wcscat(out, L" ");
+}
+
+// Offers "<typed words> <word>" at the given position for the words of
+// top[0..count), best first, scored in tier. A word equal to skip is left
+// out. The dictionary nodes of the words that can still place are looked up
+// in one batch.
+void offerWordCandidates(CandidateHeap *heap, TrieNode *dictionaryRoot, const wchar_t *typed, int position,
+                         Suggestion *top, int count, int tier, const wchar_t *skip) {
+    const wchar_t *keys[TOP_SUGGESTIONS];
+    TrieNode *ids[TOP_SUGGESTIONS];
+    int placing = 0;
+    while (placing < count && placing < TOP_SUGGESTIONS &&
+           heapAccepts(heap, candidateScore(tier, top[placing].frequency) + categoryBonus(heap, 0xff))) {
+        keys[placing] = top[placing].phrase;
+        placing++;
+    }
+    searchPrefixBatch(dictionaryRoot, keys, placing, ids);
+
+    size_t keyStart = wcslen(typed);
+    for (int i = 0; i < placing; i++) {
+        const wchar_t *word = keys[i];
+        if ((skip && wcscmp(word, skip) == 0) || keyStart + wcslen(word) >= MAX_CANDIDATE_LEN) continue;
+        wchar_t line[MAX_CANDIDATE_LEN];
+        swprintf(line, MAX_CANDIDATE_LEN, L"%ls%ls", typed, word);
+
+        // The tree has no word IDs; the word's dictionary node serves as one.
+        // N-grams carry no categories, the word's dictionary entry does, on
+        // this shard or in the table of words other shards own.
+        TrieNode *id = ids[i];
+        if (id && !id->isWord && id->frequency <= 0) id = NULL;
+        unsigned char categories = id ? id->categories : ownsWord(word) ? 0 : lookupForeignCategories(word);
+        if (!categoryWanted(heap, categories)) continue;
+        offerCandidate(heap, line, (int)keyStart, position, id,
+                       candidateScore(tier, top[i].frequency) + categoryBonus(heap, categories));
+    }
+}
+
+// Next words after the complete last word, from every n-gram order that
+// matches, highest first. tables[0..3] are the bigram..fivegram tables.
+void offerNgramContinuations(CandidateHeap *heap, NgramTable *tables[4], QueryWords *words,
+                             TrieNode *dictionaryRoot, RequestBudget *budget) {
+    wchar_t typed[MAX_CANDIDATE_LEN], context[MAX_CANDIDATE_LEN];
+    joinQueryWords(words, 0, words->count, 1, typed);
+
+    for (int order = words->count < 4 ? words->count : 4; order >= 1; order--) {
+        int tier = TIER_NGRAM + order;
+        if (!tables[order - 1] || !heapAccepts(heap, candidateScore(tier + 1, 0) - 1)) continue;
+        if (budgetExpired(budget)) return;
+
+        joinQueryWords(words, words->count - order, words->count, 1, context);
+        Suggestion top[TOP_SUGGESTIONS];
+        long total;
+        int shard;
+        ngramTrieNode *root = acquireNgramTable(tables[order - 1], context, &shard);
+        int count = lookupContinuations(traverseContext(root, context), top, TOP_SUGGESTIONS, &total, budget);
+        releaseNgramTable(tables[order - 1], shard);
+        offerWordCandidates(heap, dictionaryRoot, typed, words->count, top, count, tier, NULL);
+    }
+}
+
+// Completions of partial, the last word, that fit the words before it. The
+// partial word itself is offered only if keepExact is set.
+void offerContextCompletions(CandidateHeap *heap, NgramTable *tables[4], QueryWords *words,
+                             const wchar_t *partial, int keepExact, TrieNode *dictionaryRoot,
+                             RequestBudget *budget) {
+    if (words->count < 2) return;
+    wchar_t typed[MAX_CANDIDATE_LEN], context[MAX_CANDIDATE_LEN];
+    joinQueryWords(words, 0, words->count - 1, 1, typed);
+
+    for (int order = words->count - 1 < 4 ? words->count - 1 : 4; order >= 1; order--) {
+        int tier = TIER_CONTEXT_PREFIX + order;
+        if (!tables[order - 1] || !heapAccepts(heap, candidateScore(tier + 1, 0) - 1)) continue;
+
+        joinQueryWords(words, words->count - 1 - order, words->count - 1, 0, context);
+        Suggestion top[TOP_SUGGESTIONS];
+        int shard;
+        ngramTrieNode *root = acquireNgramTable(tables[order - 1], context, &shard);
+        int found = searchContextCompletions(root, context, partial, top, TOP_SUGGESTIONS, budget);
+        releaseNgramTable(tables[order - 1], shard);
+        // The partial word itself is already typed.
+        offerWordCandidates(heap, dictionaryRoot, typed, words->count - 1, top, found, tier,
+                            keepExact ? NULL : partial);
+    }
+}
+
+// Dictionary words below node, which ends the prefix buffer[0..depth). Words
+// no longer than minDepth are not offered. Subtrees whose maxFrequency cannot
+// place in the heap are skipped, so a full heap stops the walk early.
+void offerPrefixCompletions(CandidateHeap *heap, TrieNode *node, wchar_t *buffer, int depth, int minDepth,
+                            int position, RequestBudget *budget) {
+    if (!node || depth >= MAX_WORD_LENGTH - 1 || budgetExpired(budget)) return;
+    if (heap->only && !(node->subtreeCategories & heap->only)) return;
+    if (!heapAccepts(heap, candidateScore(TIER_PREFIX, node->maxFrequency) +
+                           categoryBonus(heap, node->subtreeCategories))) return;
+
+    if ((node->isWord || node->frequency > 0) && depth > minDepth && categoryWanted(heap, node->categories)) {
+        buffer[depth] = L'\0';
+        offerCandidate(heap, buffer, 0, position, node,
+                       candidateScore(TIER_PREFIX, node->frequency) + categoryBonus(heap, node->categories));
+    }
+
+    for (int i = 0; i < MAX_CHILDREN; ++i) {
+        if (node->children[i]) {
+            buffer[depth] = (wchar_t)(i + UNICODE_BASE);
+            offerPrefixCompletions(heap, node->children[i], buffer, depth + 1, minDepth, position, budget);
+        }
+    }
+}
+
+typedef struct FuzzySearch {
+    CandidateHeap *heap;
+    const wchar_t *query;
+    size_t queryLen;
+    int maxEdits;
+    int position;
+    wchar_t current[MAX_WORD_LENGTH];
+    RequestBudget *budget;
+} FuzzySearch;
+
+// Dictionary words within editsLeft substitutions or extra characters of the
+// query; fewer edits rank higher, then frequency.
+void fuzzyWalk(FuzzySearch *search, TrieNode *node, int depth, int editsLeft) {
+    if (node == NULL || depth >= MAX_WORD_LENGTH - 1 || budgetExpired(search->budget)) return;
+    CandidateHeap *heap = search->heap;
+    int tier = TIER_FUZZY - (search->maxEdits - editsLeft);
+    if (heap->only && !(node->subtreeCategories & heap->only)) return;
+    if (!heapAccepts(heap, candidateScore(tier, node->maxFrequency) + categoryBonus(heap, node->subtreeCategories)))
+        return;
+
+    if ((node->isWord || node->frequency > 0) && search->queryLen <= (size_t)(depth + editsLeft) &&
+        categoryWanted(heap, node->categories)) {
+        search->current[depth] = L'\0';
+        offerCandidate(heap, search->current, 0, search->position, node,
+                       candidateScore(tier, node->frequency) + categoryBonus(heap, node->categories));
+    }
+
+    for (int i = 0; i < MAX_CHILDREN; i++) {
+        if (node->children[i]) {
+            wchar_t ch = (wchar_t)(UNICODE_BASE + i);
+            search->current[depth] = ch;
+            int cost = ((size_t)depth < search->queryLen) ? (search->query[depth] != ch) : 1;
+            if (editsLeft - cost >= 0)
+                fuzzyWalk(search, node->children[i], depth + 1, editsLeft - cost);
+        }
+    }
+}
+
+void offerFuzzyMatches(CandidateHeap *heap, TrieNode *root, const wchar_t *query, int maxEdits,
+                       int position, RequestBudget *budget) {
+    static const FuzzySearch empty;
+    FuzzySearch search = empty;
+    search.heap = heap;
+    search.query = query;
+    search.queryLen = wcslen(query);
+    search.maxEdits = maxEdits;
+    search.position = position;
+    search.budget = budget;
+    fuzzyWalk(&search, root, 0, maxEdits);
+}
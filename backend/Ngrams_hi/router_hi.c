@@ -0,0 +1,494 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Router for sharded backends (see shard_hi.c): "--route host:port,..." serves
+// the same HTTP API as a backend without loading any model.
+//
+// A suggestion request is sent to every backend at once with "scored": true,
+// so each answers with its own best [score, "text"] pairs; the router merges
+// them in one candidate heap and answers with the best ten. Accepted
+// suggestions go to every backend, each of which learns the parts it owns.
+//
+// Connections to the backends are kept open and reused, a few per backend.
+// The requests to all backends are written before any answer is read, so the
+// backends work in parallel. The answers are then read as they arrive, all
+// backends in one poll, until the request's budget runs out; a backend that
+// has not answered by then is left out of the merge as if it had failed, so a
+// stalled backend cannot hold up the router. The router's budget therefore
+// has to cover the backends' own budget plus the network round trip.
+
+#define ROUTER_MAX_BACKENDS 16
+#define ROUTER_IDLE_CONNECTIONS 16
+#define ROUTER_TIMEOUT_MS 2000         // deadline of requests without a budget (learning, admin)
+#define ROUTER_DEFAULT_BUDGET_MICROS 20000
+#define ROUTER_MAX_RESPONSE (256 * 1024)
+
+typedef struct RouterBackend {
+    char name[64];                 // "host:port", as given
+    struct sockaddr_in address;
+    pthread_mutex_t lock;
+    int idle[ROUTER_IDLE_CONNECTIONS];
+    int idleCount;
+} RouterBackend;
+
+typedef struct Router {
+    RouterBackend backends[ROUTER_MAX_BACKENDS];
+    int count;
+} Router;
+
+// One backend's answer to a fanned out request. status is 0 if it failed or
+// came too late.
+typedef struct RouterReply {
+    int fd;
+    int reused;                    // fd came from the idle pool
+    int status;
+    char *body;
+    size_t bodyLen;
+    char *buffer;                  // the response read so far
+    size_t len, cap, headerLen, total;
+    int keepAlive;
+    int late;                      // still unanswered at the deadline
+} RouterReply;
+
+// Parses "host:port,host:port,...". Returns 0 on success.
+int routerInit(Router *router, const char *spec) {
+    char copy[1024], *state = NULL;
+    snprintf(copy, sizeof(copy), "%s", spec);
+    router->count = 0;
+
+    for (char *item = strtok_r(copy, ",", &state); item; item = strtok_r(NULL, ",", &state)) {
+        char *colon = strrchr(item, ':');
+        if (!colon || router->count == ROUTER_MAX_BACKENDS) {
+            fprintf(stderr, "Invalid backend %s\n", item);
+            return -1;
+        }
+        RouterBackend *backend = &router->backends[router->count];
+        snprintf(backend->name, sizeof(backend->name), "%s", item);
+        *colon = '\0';
+
+        struct addrinfo hints = { 0 }, *found;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(item, colon + 1, &hints, &found) != 0) {
+            fprintf(stderr, "Cannot resolve backend %s\n", backend->name);
+            return -1;
+        }
+        memcpy(&backend->address, found->ai_addr, sizeof(backend->address));
+        freeaddrinfo(found);
+        pthread_mutex_init(&backend->lock, NULL);
+        backend->idleCount = 0;
+        router->count++;
+    }
+    return router->count > 0 ? 0 : -1;
+}
+
+static int routerConnect(RouterBackend *backend) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct timeval timeout = { ROUTER_TIMEOUT_MS / 1000, (ROUTER_TIMEOUT_MS % 1000) * 1000 };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&backend->address, sizeof(backend->address)) != 0) {
+        LOG(LOG_WARN, L"Backend %s unreachable: %s", backend->name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// An idle connection to backend, or a new one. *reused tells which.
+static int routerTake(RouterBackend *backend, int *reused) {
+    pthread_mutex_lock(&backend->lock);
+    int fd = backend->idleCount > 0 ? backend->idle[--backend->idleCount] : -1;
+    pthread_mutex_unlock(&backend->lock);
+    *reused = fd >= 0;
+    return fd >= 0 ? fd : routerConnect(backend);
+}
+
+static void routerGiveBack(RouterBackend *backend, int fd) {
+    pthread_mutex_lock(&backend->lock);
+    if (backend->idleCount < ROUTER_IDLE_CONNECTIONS) {
+        backend->idle[backend->idleCount++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&backend->lock);
+    if (fd >= 0) close(fd);
+}
+
+static int routerSend(int fd, const char *method, const char *path, const char *body, size_t bodyLen) {
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "%s %s HTTP/1.1\r\nHost: backend\r\nContent-Type: application/json\r\n"
+                       "Content-Length: %zu\r\nConnection: keep-alive\r\n\r\n", method, path, bodyLen);
+    const char *parts[2] = { header, body };
+    size_t sizes[2] = { (size_t)len, bodyLen };
+    for (int i = 0; i < 2; i++) {
+        size_t sent = 0;
+        while (sent < sizes[i]) {
+            ssize_t n = send(fd, parts[i] + sent, sizes[i] - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            sent += n;
+        }
+    }
+    return 0;
+}
+
+// Reads what has arrived of reply's response without blocking. Returns 1 once
+// the whole response (with a Content-Length body) is in reply->body, 0 if more
+// is to come and -1 if the connection failed.
+static int routerReceive(RouterReply *reply) {
+    while (1) {
+        if (reply->len == reply->cap) {
+            size_t cap = reply->cap ? reply->cap * 2 : 4096;
+            char *grown = realloc(reply->buffer, cap + 1);
+            if (!grown) return -1;
+            reply->buffer = grown;
+            reply->cap = cap;
+        }
+        ssize_t n = recv(reply->fd, reply->buffer + reply->len, reply->cap - reply->len, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        reply->len += n;
+
+        if (!reply->headerLen) {
+            reply->buffer[reply->len] = '\0';
+            char *end = strstr(reply->buffer, "\r\n\r\n");
+            if (!end) continue;
+            char value[32];
+            reply->headerLen = end + 4 - reply->buffer;
+            if (!httpHeader(reply->buffer, reply->headerLen, "Content-Length", value, sizeof(value)) ||
+                sscanf(reply->buffer, "HTTP/1.%*d %d", &reply->status) != 1)
+                return -1;
+            reply->total = reply->headerLen + strtoul(value, NULL, 10);
+            reply->keepAlive = !httpHeader(reply->buffer, reply->headerLen, "Connection", value, sizeof(value)) ||
+                               strcasecmp(value, "close") != 0;
+            if (reply->total > ROUTER_MAX_RESPONSE) return -1;
+        }
+        if (reply->len > reply->total) return -1;    // pipelined bytes we did not ask for
+        if (reply->len == reply->total) break;
+    }
+
+    reply->bodyLen = reply->total - reply->headerLen;
+    memmove(reply->buffer, reply->buffer + reply->headerLen, reply->bodyLen);
+    reply->buffer[reply->bodyLen] = '\0';
+    reply->body = reply->buffer;
+    reply->buffer = NULL;
+    return 1;
+}
+
+// Milliseconds left until deadline, rounded up; 0 once it has passed.
+static int routerMillisLeft(const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long nanos = (deadline->tv_sec - now.tv_sec) * 1000000000LL + (deadline->tv_nsec - now.tv_nsec);
+    return nanos > 0 ? (int)((nanos + 999999) / 1000000) : 0;
+}
+
+// Drops reply's connection, and what was read from it.
+static void routerAbandon(RouterReply *reply) {
+    close(reply->fd);
+    reply->fd = -1;
+    free(reply->buffer);
+    reply->buffer = NULL;
+    reply->len = reply->cap = reply->headerLen = reply->total = 0;
+    reply->status = 0;
+}
+
+// Sends the request to every backend, then collects the answers into
+// replies[0..router->count) until budget runs out (ROUTER_TIMEOUT_MS without
+// a budget). A reused connection the backend has closed in the meantime is
+// retried once on a new one. Backends that have not answered by the deadline
+// get status 0, and their connections are closed so that the late answer is
+// not read by another request.
+void routerFanOut(Router *router, const char *method, const char *path, const char *body, size_t bodyLen,
+                  RequestBudget *budget, RouterReply *replies) {
+    struct timespec deadline;
+    if (budget) {
+        deadline = budget->deadline;
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += ROUTER_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (ROUTER_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    int pending = 0;
+    for (int b = 0; b < router->count; b++) {
+        RouterReply *reply = &replies[b];
+        memset(reply, 0, sizeof(*reply));
+        reply->fd = routerTake(&router->backends[b], &reply->reused);
+        while (reply->fd >= 0 && routerSend(reply->fd, method, path, body, bodyLen) != 0) {
+            close(reply->fd);
+            reply->fd = reply->reused ? routerConnect(&router->backends[b]) : -1;
+            reply->reused = 0;
+        }
+        if (reply->fd >= 0) pending++;
+        else LOG(LOG_WARN, L"No answer from backend %s", router->backends[b].name);
+    }
+
+    struct pollfd fds[ROUTER_MAX_BACKENDS];
+    int owners[ROUTER_MAX_BACKENDS];
+    int left;
+    while (pending > 0 && (left = routerMillisLeft(&deadline)) > 0) {
+        int count = 0;
+        for (int b = 0; b < router->count; b++) {
+            if (replies[b].fd < 0) continue;
+            fds[count].fd = replies[b].fd;
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            owners[count++] = b;
+        }
+        int ready = poll(fds, count, left);
+        if (ready < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < count && ready > 0; i++) {
+            if (!fds[i].revents) continue;
+            int b = owners[i];
+            RouterReply *reply = &replies[b];
+            int result = routerReceive(reply);
+            if (result == 0) continue;
+            if (result < 0 && reply->reused && reply->len == 0) {
+                // An idle connection the backend had closed: once more on a new one.
+                routerAbandon(reply);
+                reply->reused = 0;
+                reply->fd = routerConnect(&router->backends[b]);
+                if (reply->fd >= 0 && routerSend(reply->fd, method, path, body, bodyLen) == 0) continue;
+                if (reply->fd >= 0) close(reply->fd);
+                reply->fd = -1;
+            } else if (result < 0) {
+                routerAbandon(reply);
+            } else if (reply->keepAlive) {
+                routerGiveBack(&router->backends[b], reply->fd);
+                reply->fd = -1;
+            } else {
+                close(reply->fd);
+                reply->fd = -1;
+            }
+            if (result < 0) LOG(LOG_WARN, L"No answer from backend %s", router->backends[b].name);
+            pending--;
+        }
+    }
+
+    for (int b = 0; b < router->count; b++) {
+        if (replies[b].fd < 0) continue;
+        LOG(LOG_WARN, L"Backend %s did not answer in time", router->backends[b].name);
+        routerAbandon(&replies[b]);
+        replies[b].late = 1;
+    }
+}
+
+// Offers the [score, "text"] pairs of a scored backend answer to the heap.
+// Fuzzy matches are left out when skipFuzzy is set.
+static void routerOfferScored(CandidateHeap *heap, const char *body, size_t len, int skipFuzzy) {
+    const char *p = body, *end = body + len;
+    char text[MAX_CANDIDATE_LEN * 4];
+    wchar_t wide[MAX_CANDIDATE_LEN];
+
+    while ((p = memchr(p, '[', end - p)) != NULL) {
+        char *after;
+        double score = strtod(p + 1, &after);
+        if (after == p + 1) {
+            p++;
+            continue;
+        }
+        p = after;
+        while (p < end && (*p == ' ' || *p == ',')) p++;
+        if (!jsonReadString(&p, end, text, sizeof(text))) continue;
+        if (skipFuzzy && score < candidateScore(TIER_FUZZY + 1, 0)) continue;
+        if (mbstowcs(wide, text, MAX_CANDIDATE_LEN - 1) == (size_t)-1) continue;
+        wide[MAX_CANDIDATE_LEN - 1] = L'\0';
+        // The same word completed with and without its context comes from
+        // different backends; keyed by the last word, the better one stays.
+        wchar_t *lastWord = wcsrchr(wide, L' ');
+        offerCandidate(heap, wide, lastWord ? (int)(lastWord + 1 - wide) : 0, -1, NULL, score);
+    }
+}
+
+// Best score among the [score, "text"] pairs of a scored answer.
+static double routerBestScore(const char *body, size_t len) {
+    double best = 0;
+    for (const char *p = body; (p = memchr(p, '[', body + len - p)) != NULL; p++) {
+        double score = strtod(p + 1, NULL);
+        if (score > best) best = score;
+    }
+    return best;
+}
+
+// A copy of the JSON object body with "scored": true added.
+static char *routerScoredBody(const char *body, size_t len, size_t *outLen) {
+    const char *close = body + len;
+    while (close > body && close[-1] != '}') close--;
+    if (close == body) return NULL;
+    close--;
+    const char *last = close;
+    while (last > body && (last[-1] == ' ' || last[-1] == '\n' || last[-1] == '\r' || last[-1] == '\t')) last--;
+
+    char *copy = NULL;
+    FILE *out = open_memstream(&copy, outLen);
+    fwrite(body, 1, last - body, out);
+    fputs(last > body && last[-1] == '{' ? "\"scored\": true}" : ", \"scored\": true}", out);
+    fclose(out);
+    return copy;
+}
+
+static void routerRespond(HttpResponse *response, int status, const char *body) {
+    response->status = status;
+    response->body = strdup(body);
+    response->bodyLen = strlen(response->body);
+}
+
+// HTTP handler of the router: same paths and answers as handleHttpRequest.
+void handleRouterRequest(void *ctx, const char *method, const char *path,
+                         const char *body, size_t bodyLen, RequestBudget *budget,
+                         HttpResponse *response) {
+    Router *router = ctx;
+    RouterReply replies[ROUTER_MAX_BACKENDS];
+
+    if (strcmp(path, "/status") == 0 && strcmp(method, "GET") == 0) {
+        // {"<backend>": <its status object, or null>, ...}
+        routerFanOut(router, "GET", path, "", 0, NULL, replies);
+        FILE *out = open_memstream(&response->body, &response->bodyLen);
+        fputc('{', out);
+        for (int b = 0; b < router->count; b++) {
+            if (b) fputs(", ", out);
+            jsonAppendString(out, router->backends[b].name);
+            fputs(": ", out);
+            if (replies[b].status == 200) fwrite(replies[b].body, 1, replies[b].bodyLen, out);
+            else fputs("null", out);
+            free(replies[b].body);
+        }
+        fputc('}', out);
+        fclose(out);
+        response->status = 200;
+        return;
+    }
+    if (strcmp(path, "/stats") == 0 && strcmp(method, "GET") == 0) {
+        // The reports of all backends, one after the other.
+        routerFanOut(router, "GET", path, "", 0, NULL, replies);
+        FILE *out = open_memstream(&response->body, &response->bodyLen);
+        for (int b = 0; b < router->count; b++) {
+            fprintf(out, "== %s ==\n", router->backends[b].name);
+            if (replies[b].status == 200) fwrite(replies[b].body, 1, replies[b].bodyLen, out);
+            else fputs("unavailable\n", out);
+            free(replies[b].body);
+        }
+        fclose(out);
+        response->status = 200;
+        response->contentType = "text/plain; charset=utf-8";
+        return;
+    }
+    if (strcmp(path, "/admin") == 0 && strcmp(method, "POST") == 0) {
+        // Every backend runs the command; the replies follow one another and
+        // the worst status is returned.
+        routerFanOut(router, method, path, body, bodyLen, NULL, replies);
+        FILE *out = open_memstream(&response->body, &response->bodyLen);
+        int status = 200;
+        for (int b = 0; b < router->count; b++) {
+            fprintf(out, "== %s ==\n", router->backends[b].name);
+            if (replies[b].status) fwrite(replies[b].body, 1, replies[b].bodyLen, out);
+            else fputs("unavailable\n", out);
+            int replyStatus = replies[b].status ? replies[b].status : 502;
+            if (replyStatus > status) status = replyStatus;
+            free(replies[b].body);
+        }
+        fclose(out);
+        response->status = status;
+        response->contentType = "text/plain; charset=utf-8";
+        return;
+    }
+    if (strcmp(path, "/suggest") != 0) {
+        routerRespond(response, 404, "{\"error\": \"Not Found\"}");
+        return;
+    }
+    if (strcmp(method, "POST") != 0) {
+        routerRespond(response, 405, "{\"error\": \"Method Not Allowed\"}");
+        return;
+    }
+
+    char text[8];
+    if (jsonGetString(body, bodyLen, "text", text, sizeof(text)) && text[0] == '!') {
+        routerRespond(response, 400, "{\"error\": \"Text must not start with !\"}");
+        return;
+    }
+
+    if (jsonGetBool(body, bodyLen, "accepted")) {
+        // Every backend learns its part; loading anywhere means not learned.
+        // Not bound by the budget: the backends answer once the counts are
+        // on disk.
+        routerFanOut(router, method, path, body, bodyLen, NULL, replies);
+        int status = 200;
+        for (int b = 0; b < router->count; b++) {
+            if (replies[b].status != 200) status = replies[b].status ? replies[b].status : 502;
+            free(replies[b].body);
+        }
+        routerRespond(response, status, status == 200 ? "{\"status\": \"ok\"}" :
+                                        status == 503 ? "{\"status\": \"loading\"}" :
+                                                        "{\"error\": \"Backend unavailable\"}");
+        return;
+    }
+
+    size_t scoredLen;
+    char *scoredBody = routerScoredBody(body, bodyLen, &scoredLen);
+    if (!scoredBody) {
+        routerRespond(response, 400, "{\"error\": \"Invalid request\"}");
+        return;
+    }
+    routerFanOut(router, method, path, scoredBody, scoredLen, budget, replies);
+    free(scoredBody);
+
+    // A backend that cannot complete the word falls back to fuzzy matches; a
+    // single backend would only have done so with no completions anywhere.
+    double best = 0;
+    int answered = 0;
+    for (int b = 0; b < router->count; b++) {
+        answered += replies[b].late;    // out of time, like a backend whose budget ran out
+        if (replies[b].status != 200) continue;
+        answered++;
+        double score = routerBestScore(replies[b].body, replies[b].bodyLen);
+        if (score > best) best = score;
+    }
+    CandidateHeap heap;
+    heap.size = 0;
+    heap.only = heap.prefer = 0;
+    for (int b = 0; b < router->count; b++) {
+        if (replies[b].status == 200)
+            routerOfferScored(&heap, replies[b].body, replies[b].bodyLen, best >= candidateScore(TIER_FUZZY + 1, 0));
+        free(replies[b].body);
+    }
+    if (!answered) {
+        routerRespond(response, 502, "{\"error\": \"Backend unavailable\"}");
+        return;
+    }
+
+    qsort(heap.items, heap.size, sizeof(Candidate), compareCandidates);
+    FILE *out = open_memstream(&response->body, &response->bodyLen);
+    fputc('[', out);
+    for (int i = 0; i < heap.size; i++) {
+        char *utf8 = to_utf8(heap.items[i].text);
+        if (!utf8) continue;
+        if (i) fputs(", ", out);
+        jsonAppendString(out, utf8);
+        free(utf8);
+    }
+    fputc(']', out);
+    fclose(out);
+    response->status = 200;
+}
@@ -8,223 +8,839 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
+#include"budget_hi.c"
+#include"log_hi.c"
+#include"singleflight_hi.c"
+#include"normalize_hi.c"
+#include"shard_hi.c"
 #include"ngrams_hi.c"
 #include"dict_trie.c"
+#include"translit_hi.c"
 #include"ngram_trie_hi.c"
+#include"lookup_batch_hi.c"
+#include"ngram_shards_hi.c"
+#include"stats_hi.c"
+#include"phrase_hi.c"
+#include"ranking_hi.c"
+#include"learnlog_hi.c"
+#include"ingest_hi.c"
+#include"httpserver_hi.c"
+#include"router_hi.c"
 
-#define WORD_MAX_LEN 100
 #define MAX_FILES 100
-#define WORD_LEN 64
+#define MAX_MODELS 8
+#define MODEL_NAME_LEN 32
+#define SHARDED_NGRAM_ORDER 4     // 4- and 5-grams are loaded lazily by shard
+
+// One n-gram model per corpus (domain). All models share the dictionary
+// and unigram trie held by the TrieManager.
+typedef struct NgramModel {
+    wchar_t name[MODEL_NAME_LEN];
+    char filePrefix[MODEL_NAME_LEN + 1];   // "<name>_", prepended to generated n-gram files
+    const char *inputDir;
+    char **inputFiles;
+    int inputCount;
+    // 2- to 5-gram tables, published by the loader thread as each order
+    // finishes; NULL until then. Orders from SHARDED_NGRAM_ORDER up are
+    // paged in from disk by shard.
+    NgramTable *tables[4];
+    IngestManifest manifest;               // corpus files the tables hold, see ingest_hi.c
+} NgramModel;
 
 typedef struct TrieManager {
     TrieNode *dictionaryRoot;
     TrieNode *unigramRoot;
-    ngramTrieNode *bigramRoot;
-    ngramTrieNode *trigramRoot;
-    ngramTrieNode *fourgramRoot;
-    ngramTrieNode *fivegramRoot;
+    NgramModel models[MAX_MODELS];   // models[0] is the default
+    int modelCount;
+    LearnLog *learnLog;              // durable record of learned counts, may be NULL
+    int phraseBeamWidth;             // beam search settings for "!phrase" requests
+    int phraseDepth;
+    int modelsReady;                 // set once every model is loaded and learned counts replayed
+    FlightGroup flights;             // identical HTTP requests in flight, see singleflight_hi.c
+    pthread_mutex_t ingestLock;      // one "!ingest" at a time
 } TrieManager;
 
-char* to_utf8(const wchar_t* wstr) {
-    if (!wstr) return NULL;
+// The n-gram tables of model, bigram first. Orders still loading are NULL.
+void modelTables(NgramModel *model, NgramTable *tables[4]) {
+    for (int i = 0; i < 4; i++)
+        tables[i] = __atomic_load_n(&model->tables[i], __ATOMIC_ACQUIRE);
+}
 
-    size_t len = wcstombs(NULL, wstr, 0);
-    if (len == (size_t)-1) {
-        // Conversion failed
-        return NULL;
+int collect_files(const char *directory, char **files, const char *filter_keyword) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        perror("opendir failed");
+        return -1;
     }
 
-    char *mbstr = (char *)malloc(len + 1); // +1 for null terminator
-    if (!mbstr) return NULL;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Skip "." and ".."
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        // Build full path
+        static char pathbuf[PATH_MAX];
+        snprintf(pathbuf, sizeof(pathbuf), "%s/%s", directory, entry->d_name);
+
+        // Ensure it's a regular file
+        struct stat st;
+        if (stat(pathbuf, &st) == -1 || !S_ISREG(st.st_mode))
+            continue;
+
+        // If a filter is specified, match it
+        if (filter_keyword && !strstr(entry->d_name, filter_keyword))
+            continue;
+
+        files[count++] = strdup(pathbuf);
+        if (count >= MAX_FILES) break;
+    }
 
-    wcstombs(mbstr, wstr, len + 1);
-    return mbstr;
+    closedir(dir);
+    return count;
 }
 
-void suggestCompletions(TrieNode *node, wchar_t *buffer, int depth, FILE *out, int *count) {
-    if (*count >= 10) return;
+// Picks the model named by an optional "@name " prefix on the request line
+// and advances *input past it. Unknown or missing names select the default.
+NgramModel *selectModel(TrieManager *manager, const wchar_t **input) {
+    const wchar_t *p = *input;
+    if (*p != L'@') return &manager->models[0];
 
-    if (node->isWord || node->frequency > 0) {
-        buffer[depth] = L'\0';
+    const wchar_t *end = wcschr(p, L' ');
+    size_t len = end ? (size_t)(end - p - 1) : wcslen(p + 1);
+    *input = end ? end + 1 : p + wcslen(p);
 
-        char *utf8str = to_utf8(buffer);
-        if (utf8str) {
-            fprintf(out, "%s\n", utf8str);
-            fwprintf(stderr, L"Suggestion[%d]: %ls\n", *count, buffer);
-            free(utf8str);
-        } else {
-            fwprintf(stderr, L"UTF-8 conversion failed for suggestion[%d]: %ls\n", *count, buffer);
+    for (int i = 0; i < manager->modelCount; i++) {
+        if (wcslen(manager->models[i].name) == len && wcsncmp(manager->models[i].name, p + 1, len) == 0)
+            return &manager->models[i];
+    }
+    wchar_t wanted[MODEL_NAME_LEN];
+    swprintf(wanted, MODEL_NAME_LEN, L"%.*ls", (int)len, p + 1);
+    LOG(LOG_WARN, L"Unknown model \"%ls\", using \"%ls\"", wanted, manager->models[0].name);
+    return &manager->models[0];
+}
+
+// Feedback for an accepted suggestion: text holds the words up to and including
+// the accepted one. Bumps the unigram count of the last word and the count of
+// every trailing 2..5-gram in the model, while other requests keep running.
+void learnAccepted(TrieManager *manager, NgramModel *model, const wchar_t *text, int delta) {
+    wchar_t buffer[256], *tokens[64], *state = NULL;
+    int wordCount = 0;
+
+    normalizeDevanagari(buffer, text, 256);
+    for (wchar_t *token = wcstok(buffer, L" ", &state); token && wordCount < 64; token = wcstok(NULL, L" ", &state))
+        tokens[wordCount++] = token;
+    if (wordCount == 0) return;
+
+    if (ownsWord(tokens[wordCount - 1]))
+        learnUnigram(manager->unigramRoot, tokens[wordCount - 1], delta);
+
+    NgramTable *tables[4];
+    modelTables(model, tables);
+    wchar_t ngram[256];
+    for (int n = 2; n <= 5 && n <= wordCount; n++) {
+        if (!tables[n - 2]) continue;
+        ngram[0] = L'\0';
+        for (int i = wordCount - n; i < wordCount; i++) {
+            if (i > wordCount - n) wcscat(ngram, L" ");
+            wcscat(ngram, tokens[i]);
         }
+        if (ownsNgram(ngram)) learnNgramTable(tables[n - 2], ngram, delta);
+    }
+}
 
-        (*count)++;
+// "!ingest": merges the input files of model that are not in its manifest
+// into the live tables, the n-grams into model and the words into the shared
+// unigram counts, and writes "INGESTED <files> <words>". Only the new files
+// are read.
+void ingestNewFiles(TrieManager *manager, NgramModel *model, FILE *out) {
+    pthread_mutex_lock(&manager->ingestLock);
+    char *files[MAX_FILES];
+    int count = collect_files(model->inputDir, files, "input");
+    wchar_t (*words)[MAX_WORDLEN] = malloc(sizeof(wchar_t[MAX_WORDS][MAX_WORDLEN]));
+    if (count < 0 || !words) {
+        pthread_mutex_unlock(&manager->ingestLock);
+        free(words);
+        fprintf(out, "INGEST FAILED\n");
+        return;
     }
 
-    for (int i = 0; i < MAX_CHILDREN; ++i) {
-        if (node->children[i]) {
-            buffer[depth] = (wchar_t)(i + UNICODE_BASE);
-            suggestCompletions(node->children[i], buffer, depth + 1, out, count);
+    NgramTable *tables[4];
+    modelTables(model, tables);
+    int ingestedFiles = 0;
+    long ingestedWords = 0;
+    for (int f = 0; f < count; f++) {
+        uint64_t hash;
+        FILE *in;
+        if (hashFileContents(files[f], &hash) != 0 || manifestContains(&model->manifest, hash) ||
+            (in = fopen(files[f], "r")) == NULL) {
+            free(files[f]);
+            continue;
+        }
+        int wordCount = tokenizeCorpusFile(in, words);
+        fclose(in);
+
+        for (int i = 0; i < wordCount; i++)
+            if (ownsWord(words[i])) learnUnigram(manager->unigramRoot, words[i], 1);
+        wchar_t ngram[MAX_NGRAM_LEN];
+        for (int n = 2; n <= 5; n++) {
+            for (int i = 0; i + n <= wordCount; i++) {
+                if (!ownsNgram(words[i])) continue;
+                ngram[0] = L'\0';
+                for (int j = i; j < i + n && wcslen(ngram) + wcslen(words[j]) + 2 < MAX_NGRAM_LEN; j++) {
+                    if (j > i) wcscat(ngram, L" ");
+                    wcscat(ngram, words[j]);
+                }
+                if (ingestNgramTable(tables[n - 2], ngram) != 0)
+                    LOG(LOG_ERROR, L"Memory allocation failed, n-gram not ingested");
+            }
         }
+
+        manifestAdd(&model->manifest, hash, files[f]);
+        LOG(LOG_INFO, L"Ingested %d words from %s", wordCount, files[f]);
+        ingestedFiles++;
+        ingestedWords += wordCount;
+        free(files[f]);
     }
+    free(words);
+    pthread_mutex_unlock(&manager->ingestLock);
+    fprintf(out, "INGESTED %d %ld\n", ingestedFiles, ingestedWords);
 }
 
-void fuzzySearchToFile(TrieNode *root, const wchar_t *query, int maxEdits, FILE *out) {
-    wchar_t current[WORD_MAX_LEN];
-    int foundCount = 0;
+// Readiness report for "!status": one "<what>: ready|loading" line per
+// dictionary, n-gram order and the learned-count log.
+void writeStatus(TrieManager *manager, FILE *out) {
+    fprintf(out, "dictionary: ready\n");
+    for (int m = 0; m < manager->modelCount; m++) {
+        NgramTable *tables[4];
+        modelTables(&manager->models[m], tables);
+        char name[MODEL_NAME_LEN * 4];
+        wcstombs(name, manager->models[m].name, sizeof(name));
+        for (int n = 2; n <= 5; n++)
+            fprintf(out, "%s %d-gram: %s\n", name, n, tables[n - 2] ? "ready" : "loading");
+    }
+    fprintf(out, "learning: %s\n", __atomic_load_n(&manager->modelsReady, __ATOMIC_ACQUIRE) ? "ready" : "loading");
+}
 
-    void helper(TrieNode *node, const wchar_t *query, wchar_t *current, int depth, int maxEdits, int *foundCount) {
-        if (*foundCount >= 10 || node == NULL) return;
+// Structure report for "!stats" and --report: the dictionary trie, then every
+// n-gram table of every model that has finished loading. Sharded tables are
+// walked in full only when loadShards is set, otherwise just their resident
+// shards.
+void writeReport(TrieManager *manager, FILE *out, int loadShards) {
+    TrieStats stats = { 0 };
+    collectDictStats(manager->dictionaryRoot, 0, &stats);
+    writeTrieStats(out, "dictionary", &stats);
+
+    for (int m = 0; m < manager->modelCount; m++) {
+        NgramTable *tables[4];
+        modelTables(&manager->models[m], tables);
+        char name[MODEL_NAME_LEN * 4], label[MODEL_NAME_LEN * 4 + 16];
+        wcstombs(name, manager->models[m].name, sizeof(name));
+        for (int n = 2; n <= 5; n++) {
+            snprintf(label, sizeof(label), "%s %d-gram", name, n);
+            if (!tables[n - 2]) {
+                fprintf(out, "%s: loading\n", label);
+                continue;
+            }
+            memset(&stats, 0, sizeof(stats));
+            collectTableStats(tables[n - 2], loadShards, &stats);
+            writeTrieStats(out, label, &stats);
+        }
+    }
+}
 
-        if ((node->isWord || node->frequency > 0) && wcslen(query) <= depth + maxEdits) {
-            current[depth] = L'\0';
+// Operator commands, kept apart from handleQuery so that no text a user types
+// reaches them: "!status", "!stats", "!loglevel <level>" and "!ingest" (after
+// "@<name> " for another model). They arrive on POST /admin only. Replies
+// "UNKNOWN COMMAND" or "UNKNOWN LEVEL" for bad input, "LOADING" for an ingest
+// before the models are ready.
+void handleAdminCommand(TrieManager *manager, const wchar_t *command, FILE *out) {
+    NgramModel *model = selectModel(manager, &command);
+
+    if (wcscmp(command, L"!status") == 0) {
+        writeStatus(manager, out);
+        writeNgramMemory(&ngramShardCache, out);
+    } else if (wcscmp(command, L"!stats") == 0) {
+        writeReport(manager, out, 0);
+    } else if (wcsncmp(command, L"!loglevel ", 10) == 0) {
+        char name[16];
+        int level = wcstombs(name, command + 10, sizeof(name)) < sizeof(name) ? logLevelByName(name) : -1;
+        if (level < 0) {
+            fprintf(out, "UNKNOWN LEVEL\n");
+            return;
+        }
+        logSetLevel(level);
+        fprintf(out, "OK\n");
+    } else if (wcscmp(command, L"!ingest") == 0) {
+        if (!__atomic_load_n(&manager->modelsReady, __ATOMIC_ACQUIRE)) {
+            fprintf(out, "LOADING\n");
+            return;
+        }
+        ingestNewFiles(manager, model, out);
+    } else {
+        fprintf(out, "UNKNOWN COMMAND\n");
+    }
+}
 
-            char *utf8str = to_utf8(current);
-            if (utf8str) {
-                fprintf(out, "%s\n", utf8str);
-                fwprintf(stderr, L"Suggestion[%d] (fuzzy): %ls\n", *foundCount, current);
-                free(utf8str);
-            } else {
-                fwprintf(stderr, L"UTF-8 conversion failed for fuzzy suggestion[%d]: %ls\n", *foundCount, current);
-            }
+// Reads an "<option><category>,<category> " prefix (see parseCategories)
+// into *mask and returns the request after it. Unknown names leave *mask 0.
+const wchar_t *takeCategoryOption(const wchar_t *request, const wchar_t *option, unsigned char *mask) {
+    size_t len = wcslen(option);
+    if (wcsncmp(request, option, len) != 0) return request;
+    request += len;
+
+    char list[64];
+    size_t listLen = wcscspn(request, L" ");
+    wchar_t wide[64];
+    swprintf(wide, 64, L"%.*ls", (int)listLen, request);
+    int parsed = wcstombs(list, wide, sizeof(list)) == (size_t)-1 ? -1 : parseCategories(list);
+    *mask = parsed > 0 ? parsed : 0;
+    return request[listLen] ? request + listLen + 1 : request + listLen;
+}
 
-            (*foundCount)++;
+// budget bounds the time spent in trie walks (NULL for no limit); a degraded
+// budget also skips the fuzzy fallback. Every source feeds one ranked heap,
+// which writes the response.
+void handleQuery(TrieManager *manager, const wchar_t *request, FILE *out, RequestBudget *budget) {
+    wchar_t normalized[256];
+    normalizeDevanagari(normalized, request, 256);
+    request = normalized;
+    NgramModel *model = selectModel(manager, &request);
+    int scored = wcsncmp(request, L"!scored ", 8) == 0;    // from the router
+    if (scored) request += 8;
+    NgramTable *tables[4];
+    modelTables(model, tables);
+    CandidateHeap heap;
+    heap.size = 0;
+    heap.only = heap.prefer = 0;
+    request = takeCategoryOption(request, L"!only ", &heap.only);
+    request = takeCategoryOption(request, L"!prefer ", &heap.prefer);
+
+    if (wcsncmp(request, L"!phrase ", 8) == 0) {
+        // Whole-phrase completion: the next few words after the given context,
+        // already ranked by the beam search
+        int count = 0;
+        wchar_t **phrases = searchPhraseCompletions(tables, request + 8, manager->phraseBeamWidth,
+                                                    manager->phraseDepth, &count, budget);
+        for (int i = 0; i < count; i++) {
+            offerCandidate(&heap, phrases[i], 0, -1, NULL, candidateScore(TIER_NGRAM, count - i));
+            free(phrases[i]);
         }
+        free(phrases);
+        writeCandidates(&heap, out, scored);
+        return;
+    }
 
-        for (int i = 0; i < MAX_CHILDREN; i++) {
-            if (node->children[i]) {
-                wchar_t ch = (wchar_t)(UNICODE_BASE + i);
-                current[depth] = ch;
-                current[depth + 1] = L'\0';
+    if (wcsncmp(request, L"!learn ", 7) == 0) {
+        // Learned counts are replayed into complete models only, so feedback
+        // arriving during startup is declined rather than half applied.
+        if (!__atomic_load_n(&manager->modelsReady, __ATOMIC_ACQUIRE)) {
+            fprintf(out, "LOADING\n");
+            return;
+        }
+        learnAccepted(manager, model, request + 7, 1);
+        // Acknowledged once the group commit holding the record is on disk.
+        if (manager->learnLog &&
+            learnLogWait(manager->learnLog, learnLogAppend(manager->learnLog, model->name, request + 7, 1)) != 0) {
+            fprintf(out, "NOT PERSISTED\n");
+            return;
+        }
+        fprintf(out, "OK\n");
+        return;
+    }
 
-                int cost = (depth < wcslen(query)) ? (query[depth] != ch) : 1;
+	wchar_t input[256];
+	wcsncpy(input, request, 255);
+	input[255] = L'\0';
 
-                if (maxEdits - cost >= 0) {
-                    helper(node->children[i], query, current, depth + 1, maxEdits - cost, foundCount);
-                }
-            }
+	char utf8buf1[512];
+	wcstombs(utf8buf1, input, sizeof(utf8buf1));
+	fprintf(out, "Suggestions for: %s\n", utf8buf1);
+
+    QueryWords words;
+    splitQueryWords(&words, input);
+    int lastPosition = words.count > 0 ? words.count - 1 : 0;
+
+    // Romanized words are read as Devanagari: earlier words as their most
+    // frequent dictionary reading, the last one as every likely prefix.
+    wchar_t spelled[64][TRANSLIT_MAX_OUT];
+    TranslitMatch readings[TRANSLIT_READINGS];
+    int readingCount = 0, romanized = words.count > 0 && isRomanized(words.tokens[lastPosition]);
+    for (int i = 0; i < words.count; i++) {
+        if (!isRomanized(words.tokens[i])) continue;
+        int found = transliterateWord(manager->dictionaryRoot, words.tokens[i], readings, TRANSLIT_READINGS, budget);
+        TranslitMatch *best = bestTransliteratedWord(readings, found);
+        if (i == lastPosition) readingCount = found;
+        if (!best && i == lastPosition && found > 0) best = &readings[0];
+        if (!best) continue;
+        wcscpy(spelled[i], best->text);
+        words.tokens[i] = spelled[i];
+    }
+    const wchar_t *lastWord = words.count > 0 ? words.tokens[lastPosition] : L"";
+
+    // Next words, if the last word is complete. A romanized last word is
+    // still being typed, so it only gets completions. A sharded backend cannot
+    // tell for words held elsewhere and looks for continuations anyway.
+    if (words.count > 0 && !romanized && (!ownsWord(lastWord) || searchDict(manager->dictionaryRoot, lastWord)))
+        offerNgramContinuations(&heap, tables, &words, manager->dictionaryRoot, budget);
+
+    // Completions of the last word: those that fit the preceding words rank
+    // above plain dictionary matches, and the typed word itself is left out.
+    // With no words at all this lists the most frequent unigrams.
+    if (romanized) {
+        for (int r = 0; r < readingCount; r++) {
+            wchar_t buffer[MAX_WORD_LENGTH];
+            int depth = readings[r].length;
+            offerContextCompletions(&heap, tables, &words, readings[r].text, 1, manager->dictionaryRoot, budget);
+            wcscpy(buffer, readings[r].text);
+            offerPrefixCompletions(&heap, readings[r].node, buffer, depth, depth - 1, lastPosition, budget);
+        }
+    } else {
+        offerContextCompletions(&heap, tables, &words, lastWord, 0, manager->dictionaryRoot, budget);
+        TrieNode *prefixNode = searchPrefix(manager->dictionaryRoot, lastWord);
+        if (prefixNode && wcslen(lastWord) < MAX_WORD_LENGTH) {
+            wchar_t buffer[MAX_WORD_LENGTH];
+            wcscpy(buffer, lastWord);
+            int depth = wcslen(lastWord);
+            offerPrefixCompletions(&heap, prefixNode, buffer, depth, depth, lastPosition, budget);
         }
     }
 
-    helper(root, query, current, 0, maxEdits, &foundCount);
+    // Nothing matched: look for misspellings of the last word
+    if (heap.size == 0 && words.count > 0 && !(budget && budget->degraded))
+        offerFuzzyMatches(&heap, manager->dictionaryRoot, lastWord, 2, lastPosition, budget);
+
+    writeCandidates(&heap, out, scored);
 }
 
+// GET /status: the "!status" report as one JSON object of "<what>": true
+// (ready) or false (loading).
+void writeStatusJson(TrieManager *manager, FILE *out) {
+    char *lines = NULL;
+    size_t linesLen = 0;
+    FILE *report = open_memstream(&lines, &linesLen);
+    writeStatus(manager, report);
+    fclose(report);
 
-int getSuggestionsFromTries(const wchar_t *input, TrieManager manager, FILE *out) {
-    wchar_t w1[WORD_LEN] = L"", w2[WORD_LEN] = L"", w3[WORD_LEN] = L"", w4[WORD_LEN] = L"";
-    wchar_t buffer[256], *tokens[4] = {NULL}, *contextState = NULL;
-    int wordCount = 0;
+    int count = 0;
+    fputc('{', out);
+    for (char *line = strtok(lines, "\n"); line; line = strtok(NULL, "\n")) {
+        char *colon = strrchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        if (count++) fputs(", ", out);
+        jsonAppendString(out, line);
+        fputs(strcmp(colon + 1, " ready") == 0 ? ": true" : ": false", out);
+    }
+    fputc('}', out);
+    free(lines);
+}
 
-    wcscpy(buffer, input);
-    wchar_t *token = wcstok(buffer, L" ", &contextState);
-    while (token && wordCount < 4) {
-        tokens[wordCount++] = token;
-        token = wcstok(NULL, L" ", &contextState);
-    }
-
-   if (wordCount > 0) wcscpy(w1, tokens[wordCount - 1]);
-   if (wordCount > 1) wcscpy(w2, tokens[wordCount - 2]);
-   if (wordCount > 2) wcscpy(w3, tokens[wordCount - 3]);
-   if (wordCount > 3) wcscpy(w4, tokens[wordCount - 4]);
-
-   // Reverse order for recent context
-   wchar_t **results = NULL;
-   int resultCount = 0;
-
-   // Use most specific n-gram trie possible
-   if (wordCount >= 4 && manager.fivegramRoot)
-       results = searchNgramSuggestions(w4, w3, w2, w1, manager.fivegramRoot, &resultCount);
-   else if (wordCount >= 3 && manager.fourgramRoot)
-       results = searchNgramSuggestions(w3, w2, w1, NULL, manager.fourgramRoot, &resultCount);
-   else if (wordCount >= 2 && manager.trigramRoot)
-       results = searchNgramSuggestions(w2, w1, NULL, NULL, manager.trigramRoot, &resultCount);
-   else if (wordCount >= 1 && manager.bigramRoot)
-       results = searchNgramSuggestions(w1, NULL, NULL, NULL, manager.bigramRoot, &resultCount);
-   else if (manager.unigramRoot)
-       results = searchUnigramSuggestions(manager.unigramRoot, &resultCount);
-    int suggestionexist = 0;
-    if (results) {
-	suggestionexist = 1;
-        for (int i = 0; i < resultCount && i < 10; i++) {
-		fwprintf(stderr, L"Suggestion[%d]: %ls\n", i, results[i]);
-		char* utf8str = to_utf8(results[i]);
-	        if (utf8str) 
-		{
-    			fprintf(out, "%s\n", utf8str);
-    			free(utf8str);
-		} 
-		else 
-		{
-    			fwprintf(stderr, L"UTF-8 conversion failed for suggestion[%d]: %ls\n", i, results[i]);
-		} 
+// Turns the suggestion lines of handleQuery into a JSON array of at most 10
+// strings, or of [score, "text"] pairs for "!scored" requests.
+void writeSuggestionArray(char *lines, FILE *json, int scored) {
+    int count = 0;
+    fputc('[', json);
+    for (char *line = strtok(lines, "\n"); line && count < 10; line = strtok(NULL, "\n")) {
+        while (*line == ' ' || *line == '\t' || *line == '\r') line++;
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0 || strncmp(line, "Suggestions for:", 16) == 0) continue;
+        if (count++) fputs(", ", json);
+        char *tab = scored ? strchr(line, '\t') : NULL;
+        if (tab) {
+            *tab = '\0';
+            fprintf(json, "[%s, ", line);
+            jsonAppendString(json, tab + 1);
+            fputc(']', json);
+        } else if (scored) {
+            fputs("[0, ", json);
+            jsonAppendString(json, line);
+            fputc(']', json);
+        } else {
+            jsonAppendString(json, line);
         }
     }
-    return suggestionexist;
+    fputc(']', json);
 }
 
-int collect_files(const char *directory, char **files, const char *filter_keyword) {
-    DIR *dir = opendir(directory);
-    if (!dir) {
-        perror("opendir failed");
-        return -1;
+// Runs a /suggest request through handleQuery and turns its lines into the
+// JSON response.
+void answerSuggestRequest(TrieManager *manager, const wchar_t *request, int accepted, int scored,
+                          RequestBudget *budget, HttpResponse *response) {
+    char *lines = NULL, *json = NULL;
+    size_t linesLen = 0, jsonLen = 0;
+    FILE *out = open_memstream(&lines, &linesLen);
+    if (wcslen(request) > 0) handleQuery(manager, request, out, budget);
+    fclose(out);
+
+    FILE *jsonOut = open_memstream(&json, &jsonLen);
+    response->status = 200;
+    if (accepted && lines && strncmp(lines, "LOADING", 7) == 0) {
+        fputs("{\"status\": \"loading\"}", jsonOut);
+        response->status = 503;
+    } else if (accepted && lines && strncmp(lines, "NOT PERSISTED", 13) == 0) {
+        fputs("{\"status\": \"not persisted\"}", jsonOut);
+        response->status = 500;
+    } else if (accepted) {
+        fputs("{\"status\": \"ok\"}", jsonOut);
+    } else if (lines) {
+        writeSuggestionArray(lines, jsonOut, scored);
+    } else {
+        fputs("[]", jsonOut);
     }
+    fclose(jsonOut);
+    free(lines);
 
-    int count = 0;
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // Skip "." and ".."
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+    response->body = json;
+    response->bodyLen = jsonLen;
+}
 
-        // Build full path
-        static char pathbuf[PATH_MAX];
-        snprintf(pathbuf, sizeof(pathbuf), "%s/%s", directory, entry->d_name);
+// POST /admin with {"command": "!ingest"} (or "@news !ingest", "!loglevel
+// debug", "!stats", "!status"): the reply of handleAdminCommand as plain
+// text, with 400 for an unknown command or level and 503 while loading.
+void answerAdminRequest(TrieManager *manager, const char *body, size_t bodyLen, HttpResponse *response) {
+    char command[256];
+    wchar_t wide[256];
+    if (!jsonGetString(body, bodyLen, "command", command, sizeof(command)) ||
+        mbstowcs(wide, command, 255) == (size_t)-1) {
+        response->status = 400;
+        response->body = strdup("{\"error\": \"Missing or invalid command\"}");
+        response->bodyLen = strlen(response->body);
+        return;
+    }
+    wide[255] = L'\0';
 
-        // Ensure it's a regular file
-        struct stat st;
-        if (stat(pathbuf, &st) == -1 || !S_ISREG(st.st_mode))
-            continue;
+    FILE *out = open_memstream(&response->body, &response->bodyLen);
+    handleAdminCommand(manager, wide, out);
+    fclose(out);
+    response->contentType = "text/plain; charset=utf-8";
+    response->status = strncmp(response->body, "UNKNOWN", 7) == 0 ? 400 :
+                       strncmp(response->body, "LOADING", 7) == 0 ? 503 : 200;
+}
 
-        // If a filter is specified, match it
-        if (filter_keyword && !strstr(entry->d_name, filter_keyword))
-            continue;
+// POST /suggest with {"text": ..., "model": ..., "accepted": ...}, the same
+// request app.py accepts, optionally with "only" and "prefer" category lists
+// ("name", "noun,verb", ...) to filter or boost suggestions. The answer has the shape app.py returns: a JSON array
+// of at most 10 suggestions, or {"status": "ok"} for accepted suggestions once
+// they are on disk (503 with {"status": "loading"} while the models are still
+// loading, 500 with {"status": "not persisted"} if the learned-count log failed).
+void handleHttpRequest(void *ctx, const char *method, const char *path,
+                       const char *body, size_t bodyLen, RequestBudget *budget,
+                       HttpResponse *response) {
+    TrieManager *manager = ctx;
+    char text[1024], model[MODEL_NAME_LEN * 4], only[64], prefer[64];
+
+    if (strcmp(path, "/status") == 0 && strcmp(method, "GET") == 0) {
+        FILE *out = open_memstream(&response->body, &response->bodyLen);
+        writeStatusJson(manager, out);
+        fclose(out);
+        response->status = 200;
+        return;
+    }
+    if (strcmp(path, "/stats") == 0 && strcmp(method, "GET") == 0) {
+        FILE *out = open_memstream(&response->body, &response->bodyLen);
+        writeReport(manager, out, 0);
+        fclose(out);
+        response->contentType = "text/plain; charset=utf-8";
+        response->status = 200;
+        return;
+    }
+    if (strcmp(path, "/admin") == 0 && strcmp(method, "POST") == 0) {
+        answerAdminRequest(manager, body, bodyLen, response);
+        return;
+    }
+    if (strcmp(path, "/suggest") != 0) {
+        response->status = 404;
+        response->body = strdup("{\"error\": \"Not Found\"}");
+        response->bodyLen = strlen(response->body);
+        return;
+    }
+    if (strcmp(method, "POST") != 0) {
+        response->status = 405;
+        response->body = strdup("{\"error\": \"Method Not Allowed\"}");
+        response->bodyLen = strlen(response->body);
+        return;
+    }
+    if (!jsonGetString(body, bodyLen, "text", text, sizeof(text))) text[0] = '\0';
+    if (!jsonGetString(body, bodyLen, "model", model, sizeof(model))) model[0] = '\0';
+    if (text[0] == '!') {
+        // Commands are for POST /admin; suggestion text never carries them.
+        response->status = 400;
+        response->body = strdup("{\"error\": \"Text must not start with !\"}");
+        response->bodyLen = strlen(response->body);
+        return;
+    }
+    int accepted = jsonGetBool(body, bodyLen, "accepted");
+    int phrase = jsonGetBool(body, bodyLen, "phrase");
+    int scored = jsonGetBool(body, bodyLen, "scored");
+    if (!jsonGetString(body, bodyLen, "only", only, sizeof(only)) || accepted) only[0] = '\0';
+    if (!jsonGetString(body, bodyLen, "prefer", prefer, sizeof(prefer)) || accepted) prefer[0] = '\0';
+    if (parseCategories(only) < 0 || parseCategories(prefer) < 0 || strchr(only, ' ') || strchr(prefer, ' ')) {
+        response->status = 400;
+        response->body = strdup("{\"error\": \"Unknown category\"}");
+        response->bodyLen = strlen(response->body);
+        return;
+    }
 
-        files[count++] = strdup(pathbuf);
-        if (count >= MAX_FILES) break;
+    char utf8request[sizeof(text) + sizeof(model) + sizeof(only) + sizeof(prefer) + 40];
+    snprintf(utf8request, sizeof(utf8request), "%s%s%s%s%s%s%s%s%s%s",
+             model[0] ? "@" : "", model, model[0] ? " " : "", scored && !accepted ? "!scored " : "",
+             only[0] ? "!only " : "", only, only[0] ? " " : "",
+             prefer[0] ? "!prefer " : "", prefer, prefer[0] ? " " : "");
+    strcat(utf8request, accepted ? "!learn " : phrase ? "!phrase " : "");
+    strncat(utf8request, text, sizeof(utf8request) - strlen(utf8request) - 1);
+
+    wchar_t request[256];
+    if (mbstowcs(request, utf8request, 255) == (size_t)-1) {
+        response->status = 400;
+        response->body = strdup("{\"error\": \"Invalid UTF-8 in text\"}");
+        response->bodyLen = strlen(response->body);
+        return;
     }
+    request[255] = L'\0';
 
-    closedir(dir);
-    return count;
+
+    // Concurrent identical suggestion requests are computed once and share
+    // the response. Feedback always runs on its own, and a degraded request
+    // does not share with a full one.
+    if (accepted) {
+        answerSuggestRequest(manager, request, accepted, scored, budget, response);
+        return;
+    }
+    wchar_t key[FLIGHT_KEY_LEN];
+    key[0] = budget && budget->degraded ? L'D' : L'F';
+    normalizeDevanagari(key + 1, request, FLIGHT_KEY_LEN - 1);
+
+    int leader;
+    Flight *flight = flightJoin(&manager->flights, key, &leader);
+    if (leader) {
+        answerSuggestRequest(manager, request, accepted, scored, budget, response);
+        flightFinish(&manager->flights, flight, response->status, response->body, response->bodyLen);
+    } else if (flightWait(&manager->flights, flight, &response->status, &response->body, &response->bodyLen) == 0) {
+        LOG(LOG_DEBUG, L"Coalesced request: %ls", request);
+    } else {
+        answerSuggestRequest(manager, request, accepted, scored, budget, response);
+    }
+    flightLeave(&manager->flights, flight);
+}
+
+// Replays one recovered learned phrase into the model it was learned for.
+void applyLearnedRecord(void *ctx, const char *modelName, const wchar_t *text, int count) {
+    TrieManager *manager = ctx;
+    wchar_t name[MODEL_NAME_LEN];
+    mbstowcs(name, modelName, MODEL_NAME_LEN - 1);
+    name[MODEL_NAME_LEN - 1] = L'\0';
+
+    for (int i = 0; i < manager->modelCount; i++) {
+        if (wcscmp(manager->models[i].name, name) == 0) {
+            learnAccepted(manager, &manager->models[i], text, count);
+            return;
+        }
+    }
 }
 
+// Parses a "<name>=<directory>" or plain "<directory>" argument. A plain
+// directory is named after its last path component.
+void initModel(NgramModel *model, char *arg) {
+    char *eq = strchr(arg, '=');
+    const char *name;
+    if (eq) {
+        *eq = '\0';
+        name = arg;
+        model->inputDir = eq + 1;
+    } else {
+        model->inputDir = arg;
+        size_t len = strlen(arg);
+        while (len > 1 && arg[len - 1] == '/') arg[--len] = '\0';
+        const char *slash = strrchr(arg, '/');
+        name = slash ? slash + 1 : arg;
+    }
+
+    mbstowcs(model->name, name, MODEL_NAME_LEN - 1);
+    model->name[MODEL_NAME_LEN - 1] = L'\0';
+    snprintf(model->filePrefix, sizeof(model->filePrefix), "%.*s_", MODEL_NAME_LEN - 2, name);
+    for (int i = 0; i < 4; i++) model->tables[i] = NULL;
+}
+
+// Builds the n-gram tables of one model, publishing each order as soon as it
+// is complete so that queries can use it while the next one loads. The higher
+// orders are only split into shards here; their tries are built on demand.
+void buildModel(NgramModel *model) {
+    char path[256], shardPath[256];
+    generateNgrams(model->inputCount, model->inputFiles, model->filePrefix);
+    manifestRebuild(&model->manifest, model->filePrefix, model->inputCount, model->inputFiles);
+    grams(model->filePrefix);
+    for (int n = 2; n <= 5; n++) {
+        NgramTable *table = NULL;
+        snprintf(path, sizeof(path), "%s%dgrms.txt", model->filePrefix, n);
+        if (n >= SHARDED_NGRAM_ORDER) {
+            snprintf(shardPath, sizeof(shardPath), "%s%dgrms.shards", model->filePrefix, n);
+            if (writeShardedTable(path, shardPath) == 0)
+                table = openShardedTable(shardPath, &ngramShardCache);
+        }
+        if (!table) table = createMemoryTable(buildNgramTrie(path));
+        __atomic_store_n(&model->tables[n - 2], table, __ATOMIC_RELEASE);
+    }
+}
+
+// Loader thread: the dictionary is already serving when this starts. Models
+// come online order by order; learned counts are replayed and learning is
+// enabled once all of them are complete.
+void *loadModels(void *arg) {
+    TrieManager *manager = arg;
+    for (int m = 0; m < manager->modelCount; m++) {
+        buildModel(&manager->models[m]);
+        wprintf(L"Model \"%ls\" built from %s\n", manager->models[m].name, manager->models[m].inputDir);
+        fflush(stdout);
+    }
+
+    static LearnLog learnLog;
+    if (learnLogOpen(&learnLog, applyLearnedRecord, manager) == 0 && learnLogStart(&learnLog) == 0)
+        manager->learnLog = &learnLog;
+    else
+        fprintf(stderr, "Learned counts will not be persisted\n");
+    __atomic_store_n(&manager->modelsReady, 1, __ATOMIC_RELEASE);
+    wprintf(L"All trie Created Successfully!!\n");
+    fflush(stdout);
+    return NULL;
+}
+
+// bench_build.c includes this file for the build functions and brings its
+// own main.
+#ifndef NGRAMS_NO_MAIN
 int main(int argc, char *argv[])
 {
    setlocale(LC_ALL,"");
-   if (argc != 3) {
-        fprintf(stderr, "Usage: %s <dictionary_directory> <input_directory>\n", argv[0]);
+   const char *httpListen = NULL, *route = NULL;
+   long budgetMicros = -1;           // default depends on --route
+   int workers = HTTP_DEFAULT_WORKERS;
+   int beamWidth = DEFAULT_PHRASE_BEAM_WIDTH, phraseDepth = DEFAULT_PHRASE_DEPTH;
+   int argi = 1, badOption = 0, report = 0;
+   while (argi < argc && strncmp(argv[argi], "--", 2) == 0 && !badOption) {
+       if (strcmp(argv[argi], "--report") == 0) {
+           report = 1;
+           argi++;
+           continue;
+       }
+       if (argi + 1 >= argc) {
+           badOption = 1;
+       } else if (strcmp(argv[argi], "--http") == 0) {
+           httpListen = argv[argi + 1];
+       } else if (strcmp(argv[argi], "--budget-ms") == 0) {
+           budgetMicros = (long)(atof(argv[argi + 1]) * 1000);
+       } else if (strcmp(argv[argi], "--workers") == 0) {
+           workers = atoi(argv[argi + 1]);
+       } else if (strcmp(argv[argi], "--beam-width") == 0) {
+           beamWidth = atoi(argv[argi + 1]);
+       } else if (strcmp(argv[argi], "--phrase-words") == 0) {
+           phraseDepth = atoi(argv[argi + 1]);
+       } else if (strcmp(argv[argi], "--ngram-memory-mb") == 0) {
+           ngramShardCache.budgetBytes = (size_t)atol(argv[argi + 1]) * 1024 * 1024;
+       } else if (strcmp(argv[argi], "--shard") == 0) {
+           if (parseShardSpec(argv[argi + 1]) != 0) badOption = 1;
+       } else if (strcmp(argv[argi], "--route") == 0) {
+           route = argv[argi + 1];
+       } else if (strcmp(argv[argi], "--log-level") == 0) {
+           int level = logLevelByName(argv[argi + 1]);
+           if (level < 0) badOption = 1;
+           else logSetLevel(level);
+       } else {
+           badOption = 1;
+       }
+       argi += 2;
+   }
+   if (route ? badOption || !httpListen || argi != argc
+             : badOption || argc - argi < 2 || argc - argi - 1 > MAX_MODELS) {
+        fprintf(stderr, "Usage: %s [--http [<address>:]<port>] [--workers <n>] [--budget-ms <ms>]"
+                        " [--beam-width <n>] [--phrase-words <n>] [--ngram-memory-mb <n>]"
+                        " [--log-level error|warn|info|debug] [--shard <i>/<n>] [--report]"
+                        " <dictionary_directory> [<name>=]<input_directory> ...\n"
+                        "       %s --http [<address>:]<port> [--workers <n>] [--budget-ms <ms>]"
+                        " [--log-level <level>] --route <host>:<port>,<host>:<port>,...\n", argv[0], argv[0]);
         return 1;
     }
+   if (budgetMicros < 0) budgetMicros = route ? ROUTER_DEFAULT_BUDGET_MICROS : DEFAULT_BUDGET_MICROS;
+
+   // --route: no model here, only the HTTP server in front of the backends.
+   if (route) {
+       static Router router;
+       static HttpServer routerServer;
+       if (routerInit(&router, route) != 0 || logStart() != 0 ||
+           httpServerInit(&routerServer, httpListen, workers, budgetMicros, handleRouterRequest, &router) != 0)
+           return 1;
+       httpServerRun(&routerServer);
+       return 1;
+   }
 
-    const char *dict_dir = argv[1];
-    const char *input_dir = argv[2];
+    const char *dict_dir = argv[argi];
+
+    static TrieManager manager;
+    manager.modelCount = argc - argi - 1;
+    manager.phraseBeamWidth = beamWidth;
+    manager.phraseDepth = phraseDepth;
 
     char *dictFiles[MAX_FILES];
-    char *inputFiles[MAX_FILES];
-    int dictCount = collect_files(dict_dir, dictFiles, NULL);       
-    int inputCount = collect_files(input_dir, inputFiles, "input"); 
+    static char *inputFiles[MAX_MODELS][MAX_FILES];
+    char *allInputFiles[MAX_MODELS * MAX_FILES];
+    int allInputCount = 0;
 
-    if (dictCount < 0 || inputCount < 0) {
+    int dictCount = collect_files(dict_dir, dictFiles, NULL);       
+    if (dictCount < 0) {
         fprintf(stderr, "Error reading directories.\n");
         return 1;
     }
 
-   TrieManager manager;
-   manager.dictionaryRoot = buildUnifiedTrie(inputCount, inputFiles, dictCount, dictFiles);
+    for (int m = 0; m < manager.modelCount; m++) {
+        initModel(&manager.models[m], argv[argi + 1 + m]);
+        manager.models[m].inputFiles = inputFiles[m];
+        manager.models[m].inputCount = collect_files(manager.models[m].inputDir, inputFiles[m], "input");
+        if (manager.models[m].inputCount < 0) {
+            fprintf(stderr, "Error reading directories.\n");
+            return 1;
+        }
+        for (int i = 0; i < manager.models[m].inputCount; i++)
+            allInputFiles[allInputCount++] = inputFiles[m][i];
+    }
+
+   // The dictionary and unigram counts from every corpus are built once and shared.
+   manager.dictionaryRoot = buildUnifiedTrie(allInputCount, allInputFiles, dictCount, dictFiles);
    manager.unigramRoot = manager.dictionaryRoot;
-   generateNgrams(inputCount, inputFiles);
-   manager.bigramRoot = buildNgramTrie("2grms.txt");
-   manager.trigramRoot = buildNgramTrie("3grms.txt");
-   manager.fourgramRoot = buildNgramTrie("4grms.txt");
-   manager.fivegramRoot = buildNgramTrie("5grms.txt");
-   wprintf(L"All trie Created Successfully!!\n");
+   compileTransliterator();
+   wprintf(L"Dictionary ready, loading n-gram models\n");
+   fflush(stdout);
+
+   // --report: build every model, print the structure report and exit.
+   if (report) {
+       for (int m = 0; m < manager.modelCount; m++)
+           buildModel(&manager.models[m]);
+       // stdout is wide-oriented by now, so the report goes through a buffer.
+       char *text = NULL;
+       size_t textLen = 0;
+       FILE *out = open_memstream(&text, &textLen);
+       writeReport(&manager, out, 1);
+       fclose(out);
+       wprintf(L"%s", text);
+       free(text);
+       return 0;
+   }
+
+   if (logStart() != 0) return 1;
+   flightGroupInit(&manager.flights);
+   pthread_mutex_init(&manager.ingestLock, NULL);
+   static HttpServer httpServer;
+   pthread_t httpThread;
+   if (httpListen) {
+       if (httpServerInit(&httpServer, httpListen, workers, budgetMicros, handleHttpRequest, &manager) != 0 ||
+           pthread_create(&httpThread, NULL, httpServerRun, &httpServer) != 0)
+           return 1;
+   }
+   pthread_t loaderThread;
+   if (pthread_create(&loaderThread, NULL, loadModels, &manager) != 0) {
+       perror("pthread_create");
+       return 1;
+   }
    while(1)
    {   
     FILE *in = fopen("/var/www/hindi_suggestions/fifos/c_input_fifo", "r");
@@ -237,7 +853,7 @@ int main(int argc, char *argv[])
     }
 
     wchar_t input[256];
-    while (fgetws(input, sizeof(input), in)) {
+    while (fgetws(input, sizeof(input) / sizeof(wchar_t), in)) {
         input[wcscspn(input, L"\n")] = 0;
 
         if (wcslen(input) == 0) {
@@ -245,43 +861,9 @@ int main(int argc, char *argv[])
             continue;
         }
 
-	char utf8buf1[512];
-	wcstombs(utf8buf1, input, sizeof(utf8buf1));
-	fprintf(out, "Suggestions for: %s\n", utf8buf1);
-    
-	wchar_t lastWord[WORD_LEN] = L"";
-    	wchar_t buffer[256];
-    	wcscpy(buffer, input);  // Don't destroy original input
-    	wchar_t *state;
-    	wchar_t *token = wcstok(buffer, L" ", &state);
-    	while (token != NULL) {
-        	wcscpy(lastWord, token);
-        	token = wcstok(NULL, L" ", &state);
-    	}
-
-	if (searchDict(manager.dictionaryRoot, lastWord)) {
-        // Exact match found in dictionary, use context-aware n-gram suggestions
-        	int found = getSuggestionsFromTries(input, manager, out);
-        	if (!found) {
-            		fuzzySearchToFile(manager.dictionaryRoot, lastWord, 2, out);
-        		}
-    	} else {
-        // No exact match, try prefix match
-        	TrieNode *prefixNode = searchPrefix(manager.dictionaryRoot, lastWord);
-        	if (prefixNode) {
-            		// Suggest completions from prefix
-            		fwprintf(out, L"Suggested completions for \"%ls\":\n", lastWord);
-            		wchar_t buffer[WORD_MAX_LEN];
-            		wcsncpy(buffer, lastWord, WORD_MAX_LEN - 1);
-            		int depth = wcslen(lastWord);
-            		int count = 0;
-            		suggestCompletions(prefixNode, buffer, depth, out, &count);
-        	} else {
-            		// No prefix match, use fuzzy search
-            		fuzzySearchToFile(manager.dictionaryRoot, lastWord, 2, out);
-        	}
-    	}
-
+        RequestBudget budget;
+        budgetStart(&budget, budgetMicros, 0);
+        handleQuery(&manager, input, out, &budget);
         fflush(out);
     }
 
@@ -290,13 +872,13 @@ int main(int argc, char *argv[])
    }
 
    for (int i = 0; i < dictCount; ++i) free(dictFiles[i]);
-   for (int i = 0; i < inputCount; ++i) free(inputFiles[i]);
+   for (int i = 0; i < allInputCount; ++i) free(allInputFiles[i]);
    freeDictTrie(manager.dictionaryRoot);
-   freeDictTrie(manager.unigramRoot);
-   freeNgramTrie(manager.bigramRoot);
-   freeNgramTrie(manager.trigramRoot);
-   freeNgramTrie(manager.fourgramRoot);
-   freeNgramTrie(manager.fivegramRoot);
+   for (int m = 0; m < manager.modelCount; m++) {
+       for (int i = 0; i < 4; i++)
+           freeNgramTable(manager.models[m].tables[i]);
+   }
 
    return 0;
 }
+#endif
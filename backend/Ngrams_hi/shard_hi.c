@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <wchar.h>
+
+// Process sharding: with --shard i/N a backend holds only its part of every
+// trie, and a router (router_hi.c) sends each request to all N backends and
+// merges their ranked answers.
+//
+//   - dictionary words and unigram counts by the first letter of the word, so
+//     every completion of a partial word lives on one backend
+//   - n-grams by a hash of their first word, the start of the context; every
+//     continuation of a context then lives on one backend
+//
+// Each backend needs its own working directory, as the generated n-gram files
+// and the learned-count log are written to the current directory.
+
+int shardIndex = 0;
+int shardCount = 1;
+
+// Parses "i/N". Returns 0 if valid.
+int parseShardSpec(const char *spec) {
+    int index, count;
+    char extra;
+    if (sscanf(spec, "%d/%d%c", &index, &count, &extra) != 2 || count < 1 || index < 0 || index >= count)
+        return -1;
+    shardIndex = index;
+    shardCount = count;
+    return 0;
+}
+
+// FNV-1a over the Devanagari letters of the first word of text.
+uint32_t firstWordHash(const wchar_t *text) {
+    uint32_t hash = 2166136261u;
+    for (const wchar_t *p = text; *p && *p != L' '; p++) {
+        if (*p < 0x0900 || *p >= 0x0980) continue;
+        hash ^= (uint32_t)(*p - 0x0900);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int ownsWord(const wchar_t *word) {
+    if (shardCount == 1) return 1;
+    for (; *word; word++)
+        if (*word >= 0x0900 && *word < 0x0980) return (*word - 0x0900) % shardCount == shardIndex;
+    return shardIndex == 0;
+}
+
+// The high bits pick the backend; the n-gram tables use the low bits to pick
+// a disk shard within it.
+int ownsNgram(const wchar_t *ngram) {
+    if (shardCount == 1) return 1;
+    return (firstWordHash(ngram) >> 16) % shardCount == (uint32_t)shardIndex;
+}
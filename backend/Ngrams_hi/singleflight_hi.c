@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <pthread.h>
+
+// Coalescing of identical requests in flight.
+//
+// The first request for a key becomes the leader and computes the response;
+// requests for the same key arriving before it finishes wait for it and get a
+// copy of its response instead of computing their own. A flight is removed
+// from the table as soon as its response is published, so nothing is cached:
+// a request arriving afterwards starts a new flight.
+//
+// Typical use:
+//
+//   int leader;
+//   Flight *flight = flightJoin(group, key, &leader);
+//   if (leader) { ...compute...; flightFinish(group, flight, status, body, len); }
+//   else flightWait(group, flight, &status, &body, &len);
+//   flightLeave(group, flight);
+
+#define FLIGHT_BUCKETS 256
+#define FLIGHT_KEY_LEN 272
+
+typedef struct Flight {
+    wchar_t key[FLIGHT_KEY_LEN];
+    unsigned hash;
+    int done;
+    int refs;              // leader and waiters still holding the flight
+    int status;
+    char *body;            // the leader's response, owned by the flight
+    size_t bodyLen;
+    struct Flight *next;   // bucket chain, while in flight
+} Flight;
+
+typedef struct FlightGroup {
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    Flight *buckets[FLIGHT_BUCKETS];
+} FlightGroup;
+
+void flightGroupInit(FlightGroup *group) {
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->finished, NULL);
+    memset(group->buckets, 0, sizeof(group->buckets));
+}
+
+static unsigned flightHash(const wchar_t *key) {
+    unsigned hash = 2166136261u;
+    for (; *key; key++) {
+        hash ^= (unsigned)*key;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The flight for key: an existing one (*leader = 0) or a new one the caller
+// must complete with flightFinish (*leader = 1). NULL when out of memory; the
+// caller then computes on its own.
+Flight *flightJoin(FlightGroup *group, const wchar_t *key, int *leader) {
+    unsigned hash = flightHash(key);
+    Flight **bucket = &group->buckets[hash % FLIGHT_BUCKETS];
+
+    pthread_mutex_lock(&group->lock);
+    for (Flight *flight = *bucket; flight; flight = flight->next) {
+        if (flight->hash == hash && wcscmp(flight->key, key) == 0) {
+            flight->refs++;
+            pthread_mutex_unlock(&group->lock);
+            *leader = 0;
+            return flight;
+        }
+    }
+
+    Flight *flight = calloc(1, sizeof(Flight));
+    if (!flight) {
+        pthread_mutex_unlock(&group->lock);
+        *leader = 1;
+        return NULL;
+    }
+    wcsncpy(flight->key, key, FLIGHT_KEY_LEN - 1);
+    flight->hash = hash;
+    flight->refs = 1;
+    flight->next = *bucket;
+    *bucket = flight;
+    pthread_mutex_unlock(&group->lock);
+    *leader = 1;
+    return flight;
+}
+
+// Publishes the leader's response (copied) and wakes the waiters.
+void flightFinish(FlightGroup *group, Flight *flight, int status, const char *body, size_t bodyLen) {
+    if (!flight) return;
+    char *copy = malloc(bodyLen + 1);
+    if (copy && bodyLen) memcpy(copy, body, bodyLen);
+
+    pthread_mutex_lock(&group->lock);
+    Flight **link = &group->buckets[flight->hash % FLIGHT_BUCKETS];
+    while (*link && *link != flight) link = &(*link)->next;
+    if (*link) *link = flight->next;
+
+    flight->status = status;
+    flight->body = copy;           // NULL: the waiters compute their own
+    flight->bodyLen = copy ? bodyLen : 0;
+    flight->done = 1;
+    pthread_cond_broadcast(&group->finished);
+    pthread_mutex_unlock(&group->lock);
+}
+
+// Waits for the leader and returns a malloc'ed copy of its response. Returns
+// -1 when the copy cannot be made.
+int flightWait(FlightGroup *group, Flight *flight, int *status, char **body, size_t *bodyLen) {
+    pthread_mutex_lock(&group->lock);
+    while (!flight->done)
+        pthread_cond_wait(&group->finished, &group->lock);
+    pthread_mutex_unlock(&group->lock);
+
+    // The response no longer changes once done is set.
+    *body = malloc(flight->bodyLen + 1);
+    if (!*body || !flight->body) {
+        free(*body);
+        *body = NULL;
+        return -1;
+    }
+    memcpy(*body, flight->body, flight->bodyLen);
+    *bodyLen = flight->bodyLen;
+    *status = flight->status;
+    return 0;
+}
+
+void flightLeave(FlightGroup *group, Flight *flight) {
+    if (!flight) return;
+    pthread_mutex_lock(&group->lock);
+    int last = --flight->refs == 0;
+    pthread_mutex_unlock(&group->lock);
+    if (last) {
+        free(flight->body);
+        free(flight);
+    }
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+// Structure report of the tries: how many nodes they hold, what they cost
+// and how they are shaped, for sizing hosts, choosing pruning thresholds and
+// checking that layout changes pay off.
+//
+// An entry is what the trie stores: a word of the dictionary trie (a
+// dictionary word or a counted unigram) or an n-gram of an n-gram trie.
+
+#define STATS_MAX_FANOUT (MAX_DEVA_CHARS + 2)
+#define STATS_MAX_DEPTH 128          // deeper nodes are counted at the last depth
+#define STATS_FREQ_BUCKETS 33        // 0, 1, 2-3, 4-7, ... 2^31-
+
+typedef struct TrieStats {
+    long nodes;
+    long entries;
+    long singleChild;                // nodes with exactly one child
+    size_t bytes;
+    int shards, shardsWalked;        // sharded tables: shards in total and walked
+    long fanout[STATS_MAX_FANOUT];   // nodes by number of children
+    long depth[STATS_MAX_DEPTH];     // nodes by distance from the root, in characters
+    long frequency[STATS_FREQ_BUCKETS]; // entries by count
+} TrieStats;
+
+static int frequencyBucket(int frequency) {
+    int bucket = 0;
+    while (frequency > 0 && bucket < STATS_FREQ_BUCKETS - 1) {
+        frequency >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void countStatsNode(TrieStats *stats, int depth, int children, size_t bytes) {
+    stats->nodes++;
+    stats->bytes += bytes;
+    stats->fanout[children < STATS_MAX_FANOUT ? children : STATS_MAX_FANOUT - 1]++;
+    stats->depth[depth < STATS_MAX_DEPTH ? depth : STATS_MAX_DEPTH - 1]++;
+    if (children == 1) stats->singleChild++;
+}
+
+void collectDictStats(TrieNode *node, int depth, TrieStats *stats) {
+    int children = 0;
+    for (int i = 0; i < MAX_CHILDREN; i++) {
+        TrieNode *child = __atomic_load_n(&node->children[i], __ATOMIC_ACQUIRE);
+        if (!child) continue;
+        children++;
+        collectDictStats(child, depth + 1, stats);
+    }
+    countStatsNode(stats, depth, children, sizeof(TrieNode));
+
+    int frequency = __atomic_load_n(&node->frequency, __ATOMIC_RELAXED);
+    if (depth > 0 && (node->isWord || frequency > 0)) {
+        stats->entries++;
+        stats->frequency[frequencyBucket(frequency)]++;
+    }
+}
+
+void collectNgramStats(ngramTrieNode *node, int depth, TrieStats *stats) {
+    int children = 0;
+    for (int i = 0; i <= MAX_DEVA_CHARS; i++) {
+        ngramTrieNode *child = __atomic_load_n(&node->children[i], __ATOMIC_ACQUIRE);
+        if (!child) continue;
+        children++;
+        collectNgramStats(child, depth + 1, stats);
+    }
+    countStatsNode(stats, depth, children, ngramNodeBytes(node));
+
+    if (node->isEndOfWord) {
+        stats->entries++;
+        stats->frequency[frequencyBucket(__atomic_load_n(&node->frequency, __ATOMIC_RELAXED))]++;
+    }
+}
+
+// Statistics of an n-gram table. Of a sharded table, only the shards already
+// in memory are walked unless loadShards is set; loading them one at a time
+// keeps the walk within the shard memory budget.
+void collectTableStats(NgramTable *table, int loadShards, TrieStats *stats) {
+    if (table->fd < 0) {
+        collectNgramStats(table->root, 0, stats);
+        return;
+    }
+    stats->shards = NGRAM_SHARD_COUNT;
+    for (int s = 0; s < NGRAM_SHARD_COUNT; s++) {
+        ngramTrieNode *root = acquireNgramShard(table, s, loadShards);
+        if (!root) continue;
+        collectNgramStats(root, 0, stats);
+        stats->shardsWalked++;
+        releaseNgramTable(table, s);
+    }
+}
+
+static void writeHistogram(FILE *out, const char *label, const long *counts, int size) {
+    fprintf(out, "  %s:", label);
+    for (int i = 0; i < size; i++)
+        if (counts[i]) fprintf(out, " %d=%ld", i, counts[i]);
+    fputc('\n', out);
+}
+
+// Plain-text report of one trie: a summary line, then one line per histogram
+// listing the non-empty buckets as <bucket>=<count>. Frequency buckets are
+// written as the lowest count they hold.
+void writeTrieStats(FILE *out, const char *name, TrieStats *stats) {
+    fprintf(out, "%s:", name);
+    if (stats->shards)
+        fprintf(out, " %d/%d shards,", stats->shardsWalked, stats->shards);
+    fprintf(out, " %ld nodes, %zu bytes, %ld entries, %.1f bytes/entry, %ld single-child nodes\n",
+            stats->nodes, stats->bytes, stats->entries,
+            stats->entries ? (double)stats->bytes / stats->entries : 0.0, stats->singleChild);
+    writeHistogram(out, "fan-out", stats->fanout, STATS_MAX_FANOUT);
+    writeHistogram(out, "depth", stats->depth, STATS_MAX_DEPTH);
+
+    fprintf(out, "  frequency:");
+    for (int i = 0; i < STATS_FREQ_BUCKETS; i++)
+        if (stats->frequency[i])
+            fprintf(out, " %ld=%ld", i ? 1L << (i - 1) : 0L, stats->frequency[i]);
+    fputc('\n', out);
+}
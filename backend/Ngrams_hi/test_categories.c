@@ -0,0 +1,89 @@
+// Word category test.
+//
+//   gcc test_categories.c -o test_categories
+//   ./test_categories
+//
+// Writes one word into each of adverb.txt, verb.txt, noun.txt, adjective.txt
+// and hindi_names.txt under a temporary directory, loads them as dictionary
+// files and checks that each word carries the category of its file and no
+// other. Prints the failures and exits with status 1 if there are any. Runs
+// in C.UTF-8 unless the environment already selects a UTF-8 locale.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <locale.h>
+#include <langinfo.h>
+#include <unistd.h>
+
+#define NGRAMS_NO_MAIN
+#include "runmain.c"
+
+static const struct {
+    const char *file;
+    const char *word;          // UTF-8, as written to the file
+    unsigned char expected;
+} fixtures[] = {
+    { "adverb.txt", "अंततः", WORD_ADVERB },
+    { "verb.txt", "खाना", WORD_VERB },
+    { "noun.txt", "घर", WORD_NOUN },
+    { "adjective.txt", "सुंदर", WORD_ADJECTIVE },
+    { "hindi_names.txt", "राम", WORD_NAME },
+};
+
+#define FIXTURE_COUNT (int)(sizeof(fixtures) / sizeof(fixtures[0]))
+
+int main(void) {
+    // buildUnifiedTrie calls setlocale(LC_ALL, "") itself, so the UTF-8
+    // locale has to come from the environment.
+    if (!setlocale(LC_ALL, "") || strcmp(nl_langinfo(CODESET), "UTF-8") != 0) {
+        setenv("LC_ALL", "C.UTF-8", 1);
+        if (!setlocale(LC_ALL, "")) {
+            fprintf(stderr, "No UTF-8 locale (C.UTF-8) available\n");
+            return 1;
+        }
+    }
+    char directory[] = "/tmp/test_categoriesXXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    char *paths[FIXTURE_COUNT];
+    for (int i = 0; i < FIXTURE_COUNT; i++) {
+        paths[i] = malloc(strlen(directory) + strlen(fixtures[i].file) + 2);
+        sprintf(paths[i], "%s/%s", directory, fixtures[i].file);
+        FILE *out = fopen(paths[i], "w");
+        if (!out) {
+            perror(paths[i]);
+            return 1;
+        }
+        fprintf(out, "%s\n", fixtures[i].word);
+        fclose(out);
+    }
+
+    TrieNode *root = buildUnifiedTrie(0, NULL, FIXTURE_COUNT, paths);
+    int failures = 0;
+    for (int i = 0; i < FIXTURE_COUNT; i++) {
+        wchar_t word[MAX_WORD_LENGTH];
+        mbstowcs(word, fixtures[i].word, MAX_WORD_LENGTH);
+        normalizeDevanagari(word, word, MAX_WORD_LENGTH);
+        TrieNode *node = searchPrefix(root, word);
+        int categories = node && node->isWord ? node->categories : -1;
+        if (categoryOfFile(paths[i]) != fixtures[i].expected || categories != fixtures[i].expected) {
+            fprintf(stderr, "%s: expected categories %#x, file gives %#x, word has %#x\n", fixtures[i].file,
+                    fixtures[i].expected, categoryOfFile(paths[i]), categories);
+            failures++;
+        }
+        unlink(paths[i]);
+        free(paths[i]);
+    }
+    rmdir(directory);
+    freeDictTrie(root);
+
+    if (failures) return 1;
+    fprintf(stderr, "All %d category fixtures passed\n", FIXTURE_COUNT);
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+// Romanized input: Hindi typed phonetically in Latin letters ("bharat").
+//
+// A table of Latin spellings of Devanagari letters is compiled into a small
+// automaton (a trie over the Latin keystrokes). A romanized word is read left
+// to right; at every position the automaton yields each spelling that matches
+// there, and every spelling is applied to every surviving hypothesis by
+// stepping the dictionary trie directly. A spelling with no trie child ends
+// its hypothesis, and only the TRANSLIT_BEAM hypotheses whose subtrees hold
+// the most frequent words are kept per position (weaker ones are dropped as
+// they are added), so the cost is bounded by the word length times the beam
+// width and the working set fits on the stack.
+//
+// Ambiguity is resolved by the dictionary, not the table: "t" is tried as
+// both त and ट, "a" as the inherent vowel and as ा, "n" as न, ण and ं, and a
+// consonant after a consonant both with and without the joining virama.
+
+#define TRANSLIT_BEAM 16
+#define TRANSLIT_READINGS 4        // prefixes of a romanized last word completed
+#define TRANSLIT_MAX_LATIN 32      // longest romanized word looked up
+#define TRANSLIT_MAX_OUT 48        // longest Devanagari spelling of it
+#define TRANSLIT_MAX_RULE 4        // longest Latin spelling in the table
+#define TRANSLIT_WINDOW (TRANSLIT_MAX_RULE + 1)
+#define VIRAMA L'\x094D'
+
+typedef enum { TRANSLIT_CONSONANT, TRANSLIT_VOWEL, TRANSLIT_MODIFIER } TranslitKind;
+
+typedef struct TranslitRule {
+    const char *latin;
+    TranslitKind kind;
+    const wchar_t *letter;     // consonant, modifier or independent vowel
+    const wchar_t *sign;       // vowel sign after a consonant ("" for the inherent a), NULL otherwise
+} TranslitRule;
+
+static const TranslitRule translitRules[] = {
+    { "k",   TRANSLIT_CONSONANT, L"क", NULL },  { "q",   TRANSLIT_CONSONANT, L"क", NULL },
+    { "kh",  TRANSLIT_CONSONANT, L"ख", NULL },  { "g",   TRANSLIT_CONSONANT, L"ग", NULL },
+    { "gh",  TRANSLIT_CONSONANT, L"घ", NULL },  { "ng",  TRANSLIT_CONSONANT, L"ङ", NULL },
+    { "c",   TRANSLIT_CONSONANT, L"च", NULL },  { "ch",  TRANSLIT_CONSONANT, L"च", NULL },
+    { "chh", TRANSLIT_CONSONANT, L"छ", NULL },  { "j",   TRANSLIT_CONSONANT, L"ज", NULL },
+    { "z",   TRANSLIT_CONSONANT, L"ज", NULL },  { "jh",  TRANSLIT_CONSONANT, L"झ", NULL },
+    { "t",   TRANSLIT_CONSONANT, L"त", NULL },  { "t",   TRANSLIT_CONSONANT, L"ट", NULL },
+    { "th",  TRANSLIT_CONSONANT, L"थ", NULL },  { "th",  TRANSLIT_CONSONANT, L"ठ", NULL },
+    { "d",   TRANSLIT_CONSONANT, L"द", NULL },  { "d",   TRANSLIT_CONSONANT, L"ड", NULL },
+    { "dh",  TRANSLIT_CONSONANT, L"ध", NULL },  { "dh",  TRANSLIT_CONSONANT, L"ढ", NULL },
+    { "n",   TRANSLIT_CONSONANT, L"न", NULL },  { "n",   TRANSLIT_CONSONANT, L"ण", NULL },
+    { "p",   TRANSLIT_CONSONANT, L"प", NULL },  { "ph",  TRANSLIT_CONSONANT, L"फ", NULL },
+    { "f",   TRANSLIT_CONSONANT, L"फ", NULL },  { "b",   TRANSLIT_CONSONANT, L"ब", NULL },
+    { "bh",  TRANSLIT_CONSONANT, L"भ", NULL },  { "m",   TRANSLIT_CONSONANT, L"म", NULL },
+    { "y",   TRANSLIT_CONSONANT, L"य", NULL },  { "r",   TRANSLIT_CONSONANT, L"र", NULL },
+    { "l",   TRANSLIT_CONSONANT, L"ल", NULL },  { "v",   TRANSLIT_CONSONANT, L"व", NULL },
+    { "w",   TRANSLIT_CONSONANT, L"व", NULL },  { "sh",  TRANSLIT_CONSONANT, L"श", NULL },
+    { "sh",  TRANSLIT_CONSONANT, L"ष", NULL },  { "s",   TRANSLIT_CONSONANT, L"स", NULL },
+    { "h",   TRANSLIT_CONSONANT, L"ह", NULL },  { "x",   TRANSLIT_CONSONANT, L"क्ष", NULL },
+    { "ksh", TRANSLIT_CONSONANT, L"क्ष", NULL }, { "gy",  TRANSLIT_CONSONANT, L"ज्ञ", NULL },
+    { "tr",  TRANSLIT_CONSONANT, L"त्र", NULL }, { "shr", TRANSLIT_CONSONANT, L"श्र", NULL },
+    // Nukta letters; the tries hold them precomposed (see normalize_hi.c)
+    { "z",   TRANSLIT_CONSONANT, L"\x095B", NULL }, { "f",   TRANSLIT_CONSONANT, L"\x095E", NULL },
+    { "r",   TRANSLIT_CONSONANT, L"\x095C", NULL }, { "rh",  TRANSLIT_CONSONANT, L"\x095D", NULL },
+
+    { "a",   TRANSLIT_VOWEL, L"अ", L"" },  { "a",   TRANSLIT_VOWEL, L"आ", L"ा" },
+    { "aa",  TRANSLIT_VOWEL, L"आ", L"ा" }, { "i",   TRANSLIT_VOWEL, L"इ", L"ि" },
+    { "i",   TRANSLIT_VOWEL, L"ई", L"ी" }, { "ii",  TRANSLIT_VOWEL, L"ई", L"ी" },
+    { "ee",  TRANSLIT_VOWEL, L"ई", L"ी" }, { "u",   TRANSLIT_VOWEL, L"उ", L"ु" },
+    { "u",   TRANSLIT_VOWEL, L"ऊ", L"ू" }, { "uu",  TRANSLIT_VOWEL, L"ऊ", L"ू" },
+    { "oo",  TRANSLIT_VOWEL, L"ऊ", L"ू" }, { "e",   TRANSLIT_VOWEL, L"ए", L"े" },
+    { "ai",  TRANSLIT_VOWEL, L"ऐ", L"ै" }, { "ei",  TRANSLIT_VOWEL, L"ऐ", L"ै" },
+    { "o",   TRANSLIT_VOWEL, L"ओ", L"ो" }, { "au",  TRANSLIT_VOWEL, L"औ", L"ौ" },
+    { "ou",  TRANSLIT_VOWEL, L"औ", L"ौ" }, { "ri",  TRANSLIT_VOWEL, L"ऋ", L"ृ" },
+    { "ye",  TRANSLIT_VOWEL, L"ए", L"ए" },  // "liye" for लिए
+
+    { "n",   TRANSLIT_MODIFIER, L"ं", NULL },    { "m",   TRANSLIT_MODIFIER, L"ं", NULL },
+};
+
+#define TRANSLIT_RULE_COUNT (int)(sizeof(translitRules) / sizeof(translitRules[0]))
+
+// Automaton state: the Latin keystrokes read so far within one spelling.
+typedef struct TranslitState {
+    struct TranslitState *next[128];
+    int rules[8];              // rules spelled by exactly these keystrokes
+    int ruleCount;
+} TranslitState;
+
+static TranslitState *translitStart;
+
+// Compiles translitRules into the automaton. Called once before serving.
+void compileTransliterator(void) {
+    translitStart = calloc(1, sizeof(TranslitState));
+    for (int r = 0; r < TRANSLIT_RULE_COUNT && translitStart; r++) {
+        TranslitState *state = translitStart;
+        for (const char *p = translitRules[r].latin; *p && state; p++) {
+            if (!state->next[(int)*p]) state->next[(int)*p] = calloc(1, sizeof(TranslitState));
+            state = state->next[(int)*p];
+        }
+        if (!state) break;
+        if (state->ruleCount == 8) {
+            fprintf(stderr, "Too many spellings of \"%s\"\n", translitRules[r].latin);
+            exit(1);
+        }
+        state->rules[state->ruleCount++] = r;
+    }
+    if (!translitStart) {
+        fprintf(stderr, "Out of memory for the transliterator\n");
+        exit(1);
+    }
+}
+
+// A word typed in Latin letters: some ASCII letter and no Devanagari.
+int isRomanized(const wchar_t *word) {
+    int latin = 0;
+    for (; *word; word++) {
+        if (*word >= UNICODE_BASE && *word < UNICODE_BASE + MAX_CHILDREN) return 0;
+        if (*word < 128 && iswalpha(*word)) latin = 1;
+    }
+    return latin;
+}
+
+// One reading of the first pos keystrokes: its Devanagari spelling and the
+// dictionary node it leads to.
+typedef struct TranslitMatch {
+    wchar_t text[TRANSLIT_MAX_OUT];
+    int length;
+    TrieNode *node;
+    int afterConsonant;        // text ends in a consonant with its inherent vowel
+} TranslitMatch;
+
+typedef struct TranslitBucket {
+    TranslitMatch items[TRANSLIT_BEAM];
+    int size;
+} TranslitBucket;
+
+// Extends match by letters; fails if the dictionary has no such prefix.
+int translitStep(const TranslitMatch *match, const wchar_t *letters, int afterConsonant, TranslitMatch *out) {
+    *out = *match;
+    out->afterConsonant = afterConsonant;
+    for (const wchar_t *p = letters; *p; p++) {
+        int offset = getOffset(*p);
+        if (offset == -1 || out->length >= TRANSLIT_MAX_OUT - 1 || !out->node->children[offset]) return 0;
+        out->node = out->node->children[offset];
+        out->text[out->length++] = *p;
+    }
+    out->text[out->length] = L'\0';
+    return 1;
+}
+
+// Keeps the TRANSLIT_BEAM matches with the most frequent subtrees: once the
+// bucket is full, match replaces the weakest one if it is stronger.
+void translitAdd(TranslitBucket *bucket, const TranslitMatch *match) {
+    int weakest = -1;
+    for (int i = 0; i < bucket->size; i++) {
+        if (bucket->items[i].node == match->node && bucket->items[i].afterConsonant == match->afterConsonant)
+            return;   // same prefix, same state: one copy is enough
+        if (weakest < 0 || bucket->items[i].node->maxFrequency < bucket->items[weakest].node->maxFrequency)
+            weakest = i;
+    }
+    if (bucket->size < TRANSLIT_BEAM) bucket->items[bucket->size++] = *match;
+    else if (match->node->maxFrequency > bucket->items[weakest].node->maxFrequency) bucket->items[weakest] = *match;
+}
+
+int compareTranslitMatches(const void *a, const void *b) {
+    int fa = ((TranslitMatch *)a)->node->maxFrequency, fb = ((TranslitMatch *)b)->node->maxFrequency;
+    return (fa < fb) - (fa > fb);
+}
+
+// Applies rule to match and adds the results to bucket.
+void translitApply(const TranslitRule *rule, const TranslitMatch *match, TranslitBucket *bucket) {
+    TranslitMatch next;
+    static const wchar_t virama[] = { VIRAMA, L'\0' };
+
+    switch (rule->kind) {
+    case TRANSLIT_CONSONANT:
+        if (match->afterConsonant) {
+            // Conjunct (virama first) or a dropped inherent vowel
+            TranslitMatch joined;
+            if (translitStep(match, virama, 1, &joined) && translitStep(&joined, rule->letter, 1, &next))
+                translitAdd(bucket, &next);
+        }
+        if (translitStep(match, rule->letter, 1, &next)) translitAdd(bucket, &next);
+        break;
+    case TRANSLIT_VOWEL:
+        if (translitStep(match, match->afterConsonant ? rule->sign : rule->letter, 0, &next))
+            translitAdd(bucket, &next);
+        break;
+    case TRANSLIT_MODIFIER:
+        if (match->length > 0 && translitStep(match, rule->letter, 0, &next))
+            translitAdd(bucket, &next);
+        break;
+    }
+}
+
+// Readings of the romanized word latin that are dictionary prefixes, those
+// leading to the most frequent words first. Returns how many were stored in
+// matches (at most limit), or 0 if the budget runs out before the end of the
+// word.
+int transliterateWord(TrieNode *root, const wchar_t *latin, TranslitMatch *matches, int limit,
+                      RequestBudget *budget) {
+    size_t len = wcslen(latin);
+    if (len == 0 || len > TRANSLIT_MAX_LATIN || !translitStart) return 0;
+
+    char keys[TRANSLIT_MAX_LATIN + 1];
+    for (size_t i = 0; i < len; i++) {
+        wchar_t ch = towlower(latin[i]);
+        keys[i] = (ch > 0 && ch < 128) ? (char)ch : '?';
+    }
+    keys[len] = '\0';
+
+    // Buckets for the next few positions, reused as the read moves on.
+    TranslitBucket window[TRANSLIT_WINDOW];
+    for (int i = 0; i < TRANSLIT_WINDOW; i++) window[i].size = 0;
+    TranslitMatch start = { { 0 }, 0, root, 0 };
+    window[0].items[window[0].size++] = start;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        TranslitBucket *bucket = &window[pos % TRANSLIT_WINDOW];
+        TranslitState *state = translitStart;
+        for (size_t end = pos; end < len && (state = state->next[(int)keys[end]]); end++) {
+            TranslitBucket *target = &window[(end + 1) % TRANSLIT_WINDOW];
+            for (int r = 0; r < state->ruleCount; r++)
+                for (int i = 0; i < bucket->size; i++) {
+                    if (budgetExpired(budget)) return 0;
+                    translitApply(&translitRules[state->rules[r]], &bucket->items[i], target);
+                }
+        }
+        bucket->size = 0;
+    }
+
+    TranslitBucket *done = &window[len % TRANSLIT_WINDOW];
+    qsort(done->items, done->size, sizeof(TranslitMatch), compareTranslitMatches);
+    int count = done->size < limit ? done->size : limit;
+    memcpy(matches, done->items, count * sizeof(TranslitMatch));
+    return count;
+}
+
+// The most frequent dictionary word among matches, or NULL.
+TranslitMatch *bestTransliteratedWord(TranslitMatch *matches, int count) {
+    TranslitMatch *best = NULL;
+    for (int i = 0; i < count; i++) {
+        TrieNode *node = matches[i].node;
+        if ((node->isWord || node->frequency > 0) && (!best || node->frequency > best->node->frequency))
+            best = &matches[i];
+    }
+    return best;
+}
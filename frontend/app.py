@@ -15,6 +15,19 @@ def serve_index():
 def suggest():
     data = request.get_json()
     user_input = data.get("text", "")
+    model = data.get("model", "")
+    if user_input.startswith("!"):
+        # Commands go to the C server's POST /admin, never through the suggestion text
+        return jsonify({"error": "Text must not start with !"}), 400
+    if data.get("accepted"):
+        # Feedback for a clicked suggestion; the C server learns its counts
+        user_input = "!learn " + user_input
+    elif data.get("phrase"):
+        # Whole-phrase completion of the next few words
+        user_input = "!phrase " + user_input
+    if model:
+        # Selects one of the named corpora loaded by the C server
+        user_input = "@" + model + " " + user_input
 
     if not os.path.exists("/var/www/hindi_suggestions/fifos/c_input_fifo") or not os.path.exists("/var/www/hindi_suggestions/fifos/c_output_fifo"):
         return jsonify({"error": "FIFO pipes not found. Please ensure the C server is running."}), 500
@@ -30,6 +43,14 @@ def suggest():
         with open("/var/www/hindi_suggestions/fifos/c_output_fifo", "r", encoding="utf-8") as fifo_out:
             lines = fifo_out.readlines()
             # Clean and parse output
+            if data.get("accepted"):
+                # The C server answers OK only once the learned counts are on disk
+                reply = lines[0].strip() if lines else ""
+                if reply == "LOADING":
+                    return jsonify({"status": "loading"}), 503
+                if reply != "OK":
+                    return jsonify({"status": "not persisted"}), 500
+                return jsonify({"status": "ok"})
             suggestions = [line.strip() for line in lines if line.strip() and not line.startswith("Suggestions for:")]
             return jsonify(suggestions[:10])
 